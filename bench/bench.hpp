@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+ * Minimal self-contained timing harness for the run time benchmarks.
+ *
+ * Each benchmark is run repeatedly until it has taken at least MinimumTime, this is
+ * repeated Repeats times and the fastest run is reported to reduce scheduling noise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string_view>
+
+namespace tmp::bench {
+
+  struct measurement
+  {
+    double nanoseconds_per_iteration;
+    std::size_t iterations;
+  };
+
+  // stop the optimiser throwing away results we do not otherwise use
+  template<typename T>
+  inline void keep(T const &value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  template<typename FN>
+  auto measure(FN &&fn,
+    std::chrono::nanoseconds minimumTime = std::chrono::milliseconds{ 200 },
+    std::size_t repeats = 5) -> measurement
+  {
+    using Clock = std::chrono::steady_clock;
+
+    // find an iteration count that takes long enough to time reliably
+    std::size_t iterations{ 1 };
+    while (true) {
+      auto start = Clock::now();
+      for (std::size_t i{ 0 }; i < iterations; ++i) {
+        fn();
+      }
+      if (Clock::now() - start >= minimumTime / 4 or iterations >= (std::numeric_limits<std::size_t>::max() / 2)) {
+        break;
+      }
+      iterations *= 2;
+    }
+
+    double best = std::numeric_limits<double>::max();
+    for (std::size_t r{ 0 }; r < repeats; ++r) {
+      auto start = Clock::now();
+      for (std::size_t i{ 0 }; i < iterations; ++i) {
+        fn();
+      }
+      std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+      best = std::min(best, elapsed.count() / static_cast<double>(iterations));
+    }
+
+    return measurement{ best, iterations };
+  }
+
+  inline void report(std::string_view name, measurement m)
+  {
+    std::printf("%-40.*s %14.1f ns/iter %10zu iters\n",
+      static_cast<int>(name.size()),
+      name.data(),
+      m.nanoseconds_per_iteration,
+      m.iterations);
+  }
+
+  // Machine readable results, one CSV row per measurement after csv_header()
+  inline void csv_header()
+  {
+    std::printf("stage,variant,sample_rate,block_size,ns_per_sample,samples_per_sec\n");
+  }
+
+  inline void report_csv(std::string_view stage,
+    std::string_view variant,
+    std::uint32_t sampleRate,
+    std::uint32_t blockSize,
+    std::size_t samplesPerIteration,
+    measurement m)
+  {
+    double nsPerSample = m.nanoseconds_per_iteration / static_cast<double>(samplesPerIteration);
+    std::printf("%.*s,%.*s,%u,%u,%.4f,%.0f\n",
+      static_cast<int>(stage.size()),
+      stage.data(),
+      static_cast<int>(variant.size()),
+      variant.data(),
+      sampleRate,
+      blockSize,
+      nsPerSample,
+      1.0e9 / nsPerSample);
+  }
+
+}  // namespace tmp::bench
@@ -0,0 +1,97 @@
+/*
+ * Compares the fixed size render<BLOCK_SIZE>() entry points against calling the dynamic
+ * extent render(std::span<float>) directly with the same block length, for the stages where
+ * the per sample work is small enough that a constant length could matter.
+ *
+ * The dynamic spans are built from a length the optimiser cannot see through.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include "bench.hpp"
+#include "tmp/sources.hpp"
+#include "tmp/synth.hpp"
+#include "tmp/types.hpp"
+#include "tmp/voice_bank.hpp"
+
+namespace {
+  using namespace tmp::literals;
+
+  constexpr tmp::sample_rate Rate{ 48'000 };
+  constexpr std::size_t SamplesPerIteration = 16'384;
+  constexpr std::array<std::uint32_t, 3> BlockSizes{ 32, 128, 1024 };
+
+  constexpr tmp::envelope Envelope{ 0.005_sec, 0.0_dBfs, 0.02_sec, -3.0_dBfs, 0.005_sec };
+
+  // hide the length from the optimiser
+  auto opaque(std::size_t value) -> std::size_t
+  {
+    asm volatile("" : "+r"(value));
+    return value;
+  }
+
+  template<tmp::block_size BLOCK_SIZE, typename SOURCE>
+  void compare(std::string_view name, SOURCE const &prototype)
+  {
+    std::array<float, BLOCK_SIZE.samplesPerBlock> buffer{};
+
+    auto fixed = tmp::bench::measure([&] {
+      auto source = prototype;
+      for (std::size_t s{ 0 }; s < SamplesPerIteration; s += BLOCK_SIZE.samplesPerBlock) {
+        source.template render<BLOCK_SIZE>(buffer);
+      }
+      tmp::bench::keep(buffer[0]);
+    });
+
+    auto dynamic = tmp::bench::measure([&] {
+      auto source = prototype;
+      std::span<float> span{ buffer.data(), opaque(buffer.size()) };
+      for (std::size_t s{ 0 }; s < SamplesPerIteration; s += BLOCK_SIZE.samplesPerBlock) {
+        source.render(span);
+      }
+      tmp::bench::keep(buffer[0]);
+    });
+
+    std::printf("%.*s, block %u\n", static_cast<int>(name.size()), name.data(), BLOCK_SIZE.samplesPerBlock);
+    tmp::bench::report("  fixed render<BLOCK_SIZE>", fixed);
+    tmp::bench::report("  dynamic render(std::span<float>)", dynamic);
+  }
+
+  template<typename SYNTH>
+  auto chord() -> SYNTH
+  {
+    constexpr std::array<std::string_view, 8> Names{ "C3", "E3", "G3", "B3", "D4", "F#4", "A4", "C#5" };
+    SYNTH synth{ Envelope, -12.0_dBfs };
+    for (auto name : Names) {
+      synth.play_note(tmp::note{ name }, 0, SamplesPerIteration);
+    }
+    return synth;
+  }
+
+  template<tmp::block_size BLOCK_SIZE>
+  void compare_stages()
+  {
+    compare<BLOCK_SIZE>("wavetable_oscillator", tmp::sources::wavetable_oscillator<Rate>{ 440.0_hz, -6.0_dBfs });
+    compare<BLOCK_SIZE>("wavetable_synth, 8 voices", chord<tmp::instruments::wavetable_synth<Rate>>());
+    compare<BLOCK_SIZE>("wavetable_bank_synth, 8 voices", chord<tmp::instruments::wavetable_bank_synth<Rate>>());
+  }
+
+  template<std::size_t... BLOCK>
+  void compare_block_sizes(std::index_sequence<BLOCK...>)
+  {
+    (compare_stages<tmp::block_size{ BlockSizes[BLOCK] }>(), ...);
+  }
+}  // namespace
+
+
+int main()
+{
+  compare_block_sizes(std::make_index_sequence<BlockSizes.size()>{});
+  return 0;
+}
@@ -0,0 +1,121 @@
+#
+# Measures how expensive each add_wav song is to build, run by the build-bench target:
+#
+#   cmake -DCOMPILER=... -DCOMPILER_ID=GNU|Clang -DSTD_FLAG=-std=c++23 -DINCLUDE_DIR=...
+#         -DSONGS=name=source,... -DOPS_LIMITS=1000000,... -DWORK_DIR=... -DOUTPUT=... -P build_bench.cmake
+#
+# A song compiled with preprocessor definitions, as add_wav SCORE and SLICES songs are, lists them after
+# its source as name=source@DEFINE@DEFINE=value.
+#
+# Each song is compiled once with an unlimited constexpr ops limit under -ftime-report to record the
+# wall time and compiler memory, then again with each of OPS_LIMITS in turn (smallest first) until
+# one succeeds, giving the order of magnitude of constexpr operations the song needs. Clang's
+# -fconstexpr-steps is an unsigned int, so limits above 2147483647 are skipped for it.
+# Peak memory (RSS) is only available when GNU time is installed.
+#
+
+foreach(VAR COMPILER COMPILER_ID STD_FLAG INCLUDE_DIR SONGS OPS_LIMITS WORK_DIR OUTPUT)
+    if(NOT DEFINED ${VAR})
+        message(FATAL_ERROR "build_bench.cmake: ${VAR} must be set")
+    endif()
+endforeach()
+
+if(COMPILER_ID MATCHES "Clang")
+    set(OPS_FLAG "-fconstexpr-steps=")
+    set(OPS_EXCEEDED "maximum step limit")
+    set(UNLIMITED_OPS 2147483647)  # clang takes an unsigned int
+else()
+    set(OPS_FLAG "-fconstexpr-ops-limit=")
+    set(OPS_EXCEEDED "operation count exceeds limit")
+    set(UNLIMITED_OPS 9999999999999)  # matches add_wav
+endif()
+
+find_program(GNU_TIME NAMES time PATHS /usr/bin NO_DEFAULT_PATH)
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+string(REPLACE "," ";" SONGS "${SONGS}")
+string(REPLACE "," ";" OPS_LIMITS "${OPS_LIMITS}")
+
+# a limit the compiler cannot take would fail on the flag itself and read as a failed song
+set(USABLE_LIMITS)
+foreach(LIMIT ${OPS_LIMITS})
+    if(LIMIT GREATER UNLIMITED_OPS)
+        message(STATUS "build-bench: ops limit ${LIMIT} is above the largest ${COMPILER_ID} takes, skipped")
+    else()
+        list(APPEND USABLE_LIMITS ${LIMIT})
+    endif()
+endforeach()
+if(NOT USABLE_LIMITS)
+    message(FATAL_ERROR "build_bench.cmake: no OPS_LIMITS at or below ${UNLIMITED_OPS}")
+endif()
+set(OPS_LIMITS ${USABLE_LIMITS})
+
+# compile SOURCE with the given ops limit, sets RESULT (0 on success) and OUTPUT_TEXT in the caller
+function(compile_song NAME SOURCE DEFINES LIMIT)
+    list(TRANSFORM DEFINES PREPEND -D)
+    set(COMMAND ${COMPILER} ${STD_FLAG} -I${INCLUDE_DIR} ${DEFINES} -ftime-report ${OPS_FLAG}${LIMIT}
+        -c ${SOURCE} -o ${WORK_DIR}/${NAME}.o)
+    if(GNU_TIME)
+        set(COMMAND ${GNU_TIME} -f "peak-rss-kb %M" ${COMMAND})
+    endif()
+    execute_process(COMMAND ${COMMAND} RESULT_VARIABLE result OUTPUT_VARIABLE out ERROR_VARIABLE err)
+    set(RESULT ${result} PARENT_SCOPE)
+    set(OUTPUT_TEXT "${out}${err}" PARENT_SCOPE)
+endfunction()
+
+set(TABLE "| Song | Wall time (s) | Compiler memory | Peak RSS | Ops limit needed |\n")
+string(APPEND TABLE "|------|---------------|-----------------|----------|------------------|\n")
+
+foreach(SONG ${SONGS})
+    string(REPLACE "@" ";" DEFINES "${SONG}")
+    list(POP_FRONT DEFINES SONG)
+    string(REPLACE "=" ";" SONG "${SONG}")
+    list(GET SONG 0 NAME)
+    list(GET SONG 1 SOURCE)
+    message(STATUS "build-bench: ${NAME}")
+
+    compile_song(${NAME} ${SOURCE} "${DEFINES}" ${UNLIMITED_OPS})
+    file(WRITE ${WORK_DIR}/${NAME}.time-report.txt "${OUTPUT_TEXT}")
+
+    if(NOT RESULT EQUAL 0)
+        string(APPEND TABLE "| ${NAME} | failed, see ${NAME}.time-report.txt | | | |\n")
+        continue()
+    endif()
+
+    # GCC:   " TOTAL   :   usr   sys   wall   mem"
+    # Clang: "Total Execution Time: usr seconds (wall wall clock)"
+    set(WALL "-")
+    set(MEMORY "-")
+    if(OUTPUT_TEXT MATCHES "TOTAL +: +[0-9.]+ +[0-9.]+ +([0-9.]+) +([0-9.]+[kMG]?)")
+        set(WALL ${CMAKE_MATCH_1})
+        set(MEMORY ${CMAKE_MATCH_2})
+    elseif(OUTPUT_TEXT MATCHES "Total Execution Time: [0-9.]+ seconds \\(([0-9.]+) wall clock\\)")
+        set(WALL ${CMAKE_MATCH_1})
+    endif()
+
+    set(PEAK "-")
+    if(OUTPUT_TEXT MATCHES "peak-rss-kb ([0-9]+)")
+        math(EXPR PEAK "${CMAKE_MATCH_1} / 1024")
+        set(PEAK "${PEAK}M")
+    endif()
+
+    # stepped ops limits, stop at the first that is enough
+    list(GET OPS_LIMITS -1 LARGEST)
+    set(NEEDED "> ${LARGEST}")
+    foreach(LIMIT ${OPS_LIMITS})
+        compile_song(${NAME} ${SOURCE} "${DEFINES}" ${LIMIT})
+        if(RESULT EQUAL 0)
+            set(NEEDED "<= ${LIMIT}")
+            break()
+        elseif(NOT OUTPUT_TEXT MATCHES "${OPS_EXCEEDED}")
+            set(NEEDED "failed at ${LIMIT}")
+            break()
+        endif()
+    endforeach()
+
+    string(APPEND TABLE "| ${NAME} | ${WALL} | ${MEMORY} | ${PEAK} | ${NEEDED} |\n")
+endforeach()
+
+file(WRITE ${OUTPUT} "${TABLE}")
+message("${TABLE}")
+message(STATUS "build-bench: summary written to ${OUTPUT}")
@@ -0,0 +1,110 @@
+/*
+ * Stress test for live event injection: several threads push thousands of notes a second into a
+ * sequencer through an event_inbox while the realtime_engine plays it at the sample clock.
+ *
+ *   bench-live-events [seconds]      each configuration plays for `seconds` (default 2)
+ *
+ * Producers stamp each note `position() + lookahead`. With no lookahead a note that arrives while its
+ * block is being rendered misses its sample and plays a block late, a lookahead of one block or more
+ * should make every note sample accurate. For each run it reports the notes merged, how many were late
+ * and by how much, the mean and worst block render time against the block period, and underruns.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "tmp/event_inbox.hpp"
+#include "tmp/realtime.hpp"
+#include "tmp/sequencer.hpp"
+#include "tmp/synth.hpp"
+#include "tmp/types.hpp"
+
+namespace {
+  using namespace tmp::literals;
+
+  constexpr tmp::sample_rate Rate{ 48'000 };
+  constexpr tmp::block_size BlockSize{ 128 };
+  constexpr std::uint32_t NoteLength = 480;  // 10 ms
+  constexpr tmp::envelope Envelope{ 0.002_sec, 0.0_dBfs, 0.003_sec, -6.0_dBfs, 0.005_sec };
+
+  struct discard_sink
+  {
+    void operator()(std::span<std::byte const> data) const
+    {
+      tmp::bench::keep(data);
+    }
+  };
+
+  void run(std::size_t producers, std::size_t eventsPerSecond, std::uint32_t lookahead, double seconds)
+  {
+    tmp::instruments::wavetable_synth<Rate> synth{ Envelope, -30.0_dBfs };
+    tmp::sequencer sequencer{ synth };
+    tmp::event_inbox inbox{ 1024 };
+    sequencer.attach_inbox(inbox);
+
+    tmp::realtime_engine<Rate, discard_sink, BlockSize> engine{ discard_sink{} };
+    engine.start(sequencer);
+
+    std::atomic<bool> running{ true };
+    std::vector<std::jthread> threads;
+    auto const interval = std::chrono::nanoseconds{ 1'000'000'000 } * producers / eventsPerSecond;
+    for (std::size_t p{ 0 }; p < producers; ++p) {
+      threads.emplace_back([&, p] {
+        auto next = std::chrono::steady_clock::now() + (interval * p / producers);
+        for (std::uint8_t n{ 0 }; running.load(std::memory_order_relaxed); ++n) {
+          std::this_thread::sleep_until(next);
+          next += interval;
+          auto const noteNumber = static_cast<std::uint8_t>(48 + ((n + (p * 7)) % 36));
+          inbox.push(tmp::compact_event{ noteNumber, inbox.position() + lookahead, NoteLength });
+        }
+      });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>{ seconds });
+    running.store(false);
+    threads.clear();
+    engine.stop();
+
+    auto const events = inbox.stats();
+    auto const playback = engine.stats();
+    auto ms = [](std::chrono::nanoseconds ns) { return std::chrono::duration<double, std::milli>(ns).count(); };
+    std::printf("%9zu %10zu %9u %8llu %8llu %8llu %6.2f ms %9.3f ms %9.3f ms %9.3f ms %9llu\n",
+      producers,
+      producers == 0 ? 0 : eventsPerSecond,
+      lookahead,
+      static_cast<unsigned long long>(events.merged),
+      static_cast<unsigned long long>(events.rejected),
+      static_cast<unsigned long long>(events.late),
+      1000.0 * events.maxLateSamples / Rate.samples_per_second,
+      ms(playback.meanRenderTime),
+      ms(playback.maxRenderTime),
+      ms(playback.blockPeriod),
+      static_cast<unsigned long long>(playback.underruns));
+  }
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  double seconds{ 2.0 };
+  if (argc > 1) {
+    seconds = std::strtod(argv[1], nullptr);
+  }
+
+  std::printf("producers events/s lookahead   merged rejected     late  max late  mean render   max render  "
+              "block period underruns\n");
+  run(0, 1, 0, seconds);
+  for (std::uint32_t lookahead : { 0U, BlockSize.samplesPerBlock, 4 * BlockSize.samplesPerBlock }) {
+    run(4, 2'000, lookahead, seconds);
+    run(4, 8'000, lookahead, seconds);
+    run(8, 16'000, lookahead, seconds);
+  }
+  return 0;
+}
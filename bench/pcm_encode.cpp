@@ -0,0 +1,79 @@
+/*
+ * Compares the block PCM16 encoder (SSE2 / NEON at run time) against the
+ * original per-sample clamp, multiply, cast and write_le loop.
+ *
+ * The outputs are checked to be identical before timing.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "bench.hpp"
+#include "tmp/pcm_encode.hpp"
+#include "tmp/wav_render.hpp"
+
+namespace {
+  // the loop wav_renderer_mono used before the block encoder
+  void encode_original(std::span<float const> samples, std::span<std::byte> buffer)
+  {
+    for (std::size_t i{ 0 }; i < samples.size(); ++i) {
+      auto clamped = std::clamp(samples[i], -1.0F, 1.0F);
+      auto val = static_cast<std::int16_t>(clamped * std::numeric_limits<int16_t>::max());
+      tmp::detail::write_le(buffer.subspan(i * 2, 2), static_cast<std::uint16_t>(val));
+    }
+  }
+
+  // a slightly over driven sine so the clamp is exercised
+  auto make_samples(std::size_t count) -> std::vector<float>
+  {
+    std::vector<float> samples(count);
+    for (std::size_t i{ 0 }; i < count; ++i) {
+      samples[i] = 1.2F * std::sin(static_cast<float>(i) * 0.01F);
+    }
+    return samples;
+  }
+}  // namespace
+
+
+int main()
+{
+  for (std::size_t count : { 128U, 4'096U, 1'048'576U }) {
+    auto samples = make_samples(count);
+    std::vector<std::byte> original(count * 2);
+    std::vector<std::byte> block(count * 2);
+    std::vector<std::byte> dithered(count * 2);
+
+    encode_original(samples, original);
+    tmp::detail::encode_pcm16(samples, block);
+    if (original != block) {
+      std::printf("block encoder output differs from the original loop for %zu samples\n", count);
+      return 1;
+    }
+
+    auto loop = tmp::bench::measure([&] {
+      encode_original(samples, original);
+      tmp::bench::keep(original.data());
+    });
+    auto simd = tmp::bench::measure([&] {
+      tmp::detail::encode_pcm16(samples, block);
+      tmp::bench::keep(block.data());
+    });
+    auto tpdf = tmp::bench::measure([&] {
+      tmp::detail::tpdf_noise dither{};
+      tmp::detail::encode_pcm16(samples, dithered, dither);
+      tmp::bench::keep(dithered.data());
+    });
+
+    std::printf("%zu samples\n", count);
+    tmp::bench::report("  original loop", loop);
+    tmp::bench::report("  block encoder", simd);
+    tmp::bench::report("  block encoder (tpdf dither)", tpdf);
+  }
+  return 0;
+}
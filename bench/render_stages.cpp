@@ -0,0 +1,348 @@
+/*
+ * Times each stage of the render pipeline at run time for a range of block sizes and
+ * sample rates, printing CSV (see bench::csv_header) so results can be compared between builds.
+ *
+ *   bench-render [stage]     only run stages whose name contains `stage`
+ *
+ * Every measurement renders the same number of samples so results across block sizes compare
+ * directly. Where a stage needs fresh state each iteration (notes, events) setting it up is
+ * included in the time, it is small next to the rendering.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "tmp/parallel_render.hpp"
+#include "tmp/sequencer.hpp"
+#include "tmp/sources.hpp"
+#include "tmp/synth.hpp"
+#include "tmp/types.hpp"
+#include "tmp/upsampler.hpp"
+#include "tmp/wav_render.hpp"
+
+namespace {
+  using namespace tmp::literals;
+
+  constexpr std::size_t SamplesPerIteration = 16'384;
+  constexpr std::array<std::uint32_t, 6> BlockSizes{ 32, 64, 128, 256, 512, 1024 };
+  constexpr std::array<std::uint32_t, 2> SampleRates{ 8'000, 48'000 };
+
+  constexpr tmp::envelope Envelope{ 0.005_sec, 0.0_dBfs, 0.02_sec, -3.0_dBfs, 0.005_sec };
+
+  std::string_view filter;
+
+  auto enabled(std::string_view stage) -> bool
+  {
+    return filter.empty() or stage.find(filter) != std::string_view::npos;
+  }
+
+  // a spread of notes so voices are not all in phase
+  auto chord_note(std::size_t voice) -> tmp::note
+  {
+    constexpr std::array<std::string_view, 8> Names{ "C3", "E3", "G3", "B3", "D4", "F#4", "A4", "C#5" };
+    return tmp::note{ Names[voice % Names.size()] };
+  }
+
+  template<tmp::sample_rate RATE>
+  class null_instrument
+  {
+  public:
+    constexpr void play_note(tmp::note, std::uint32_t, std::uint32_t)
+    {
+      ++notes;
+    }
+
+    template<tmp::block_size BLOCK_SIZE>
+    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock>)
+    {}
+
+    std::size_t notes{ 0 };
+  };
+
+  template<tmp::block_size BLOCK_SIZE, typename SOURCE>
+  void render_samples(SOURCE &source, std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+  {
+    for (std::size_t s{ 0 }; s < SamplesPerIteration; s += BLOCK_SIZE.samplesPerBlock) {
+      source.template render<BLOCK_SIZE>(buffer);
+    }
+    tmp::bench::keep(buffer[0]);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void report(std::string_view stage, std::string_view variant, tmp::bench::measurement m)
+  {
+    tmp::bench::report_csv(
+      stage, variant, RATE.samples_per_second, BLOCK_SIZE.samplesPerBlock, SamplesPerIteration, m);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_oscillator()
+  {
+    std::array<float, BLOCK_SIZE.samplesPerBlock> buffer{};
+
+    tmp::sources::sin_oscillator<RATE> sin{ 440.0_hz, -6.0_dBfs };
+    report<RATE, BLOCK_SIZE>(
+      "oscillator", "sin", tmp::bench::measure([&] { render_samples<BLOCK_SIZE>(sin, buffer); }));
+
+    tmp::sources::wavetable_oscillator<RATE> wavetable{ 440.0_hz, -6.0_dBfs };
+    report<RATE, BLOCK_SIZE>(
+      "oscillator", "wavetable", tmp::bench::measure([&] { render_samples<BLOCK_SIZE>(wavetable, buffer); }));
+
+    tmp::sources::saw_oscillator<RATE> saw{ 440.0_hz, -6.0_dBfs };
+    report<RATE, BLOCK_SIZE>(
+      "oscillator", "polyblep_saw", tmp::bench::measure([&] { render_samples<BLOCK_SIZE>(saw, buffer); }));
+
+    tmp::sources::square_oscillator<RATE> square{ 440.0_hz, -6.0_dBfs };
+    report<RATE, BLOCK_SIZE>(
+      "oscillator", "polyblep_square", tmp::bench::measure([&] { render_samples<BLOCK_SIZE>(square, buffer); }));
+
+    tmp::sources::triangle_oscillator<RATE> triangle{ 440.0_hz, -6.0_dBfs };
+    report<RATE, BLOCK_SIZE>(
+      "oscillator", "polyblep_triangle", tmp::bench::measure([&] { render_samples<BLOCK_SIZE>(triangle, buffer); }));
+
+    // the same saw built from one wavetable sine per harmonic below Nyquist
+    std::vector<tmp::sources::wavetable_oscillator<RATE>> partials;
+    auto const nyquist = static_cast<float>(RATE.samples_per_second) / 2;
+    for (float n{ 1.0F }; 440.0F * n < nyquist; n += 1.0F) {
+      partials.emplace_back(tmp::frequency{ 440.0F * n }, tmp::volume{ 0.5F / n });
+    }
+    auto additive = tmp::bench::measure([&] {
+      for (std::size_t s{ 0 }; s < SamplesPerIteration; s += BLOCK_SIZE.samplesPerBlock) {
+        std::ranges::fill(buffer, 0.0F);
+        for (std::size_t n{ 0 }; n < partials.size(); ++n) {
+          partials[n].render_add(buffer, n % 2 == 0 ? -1.0F : 1.0F);
+        }
+      }
+      tmp::bench::keep(buffer[0]);
+    });
+    report<RATE, BLOCK_SIZE>("oscillator", "additive_saw_" + std::to_string(partials.size()) + "_partials", additive);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_envelope()
+  {
+    std::array<float, BLOCK_SIZE.samplesPerBlock> buffer{};
+    tmp::sources::envelope_generator<RATE> envelope{ Envelope };
+
+    // a whole note per iteration, so every segment is covered in proportion
+    auto m = tmp::bench::measure([&] {
+      envelope.note_on(0, SamplesPerIteration / 2);
+      for (std::size_t s{ 0 }; s < SamplesPerIteration; s += BLOCK_SIZE.samplesPerBlock) {
+        std::ranges::fill(buffer, 1.0F);
+        envelope.template apply<BLOCK_SIZE>(buffer);
+      }
+      tmp::bench::keep(buffer[0]);
+    });
+    report<RATE, BLOCK_SIZE>("envelope", "adsr", m);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE, typename SYNTH>
+  void bench_synth_voices(std::string_view variant, std::size_t voices)
+  {
+    std::array<float, BLOCK_SIZE.samplesPerBlock> buffer{};
+    auto m = tmp::bench::measure([&] {
+      SYNTH synth{ Envelope, -6.0_dBfs };
+      for (std::size_t v{ 0 }; v < voices; ++v) {
+        synth.play_note(chord_note(v), 0, SamplesPerIteration);
+      }
+      render_samples<BLOCK_SIZE>(synth, buffer);
+    });
+    report<RATE, BLOCK_SIZE>("synth", variant, m);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_synth()
+  {
+    using tmp::instruments::sin_synth;
+    using tmp::instruments::wavetable_synth;
+    bench_synth_voices<RATE, BLOCK_SIZE, sin_synth<RATE>>("sin_1_voice", 1);
+    bench_synth_voices<RATE, BLOCK_SIZE, sin_synth<RATE>>("sin_8_voices", 8);
+    bench_synth_voices<RATE, BLOCK_SIZE, sin_synth<RATE>>("sin_64_voices", 64);
+    bench_synth_voices<RATE, BLOCK_SIZE, wavetable_synth<RATE>>("wavetable_1_voice", 1);
+    bench_synth_voices<RATE, BLOCK_SIZE, wavetable_synth<RATE>>("wavetable_8_voices", 8);
+    bench_synth_voices<RATE, BLOCK_SIZE, wavetable_synth<RATE>>("wavetable_64_voices", 64);
+  }
+
+  // FACTOR > 1 runs the parts at RATE / FACTOR and upsamples their mix
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE, std::uint32_t FACTOR>
+  void bench_mixer_parts(std::string_view variant)
+  {
+    using tmp::instruments::wavetable_synth;
+    constexpr tmp::sample_rate PartRate{ RATE.samples_per_second / FACTOR };
+    using part = wavetable_synth<PartRate>;
+
+    std::array<float, BLOCK_SIZE.samplesPerBlock> buffer{};
+    auto m = tmp::bench::measure([&] {
+      std::array<part, 4> parts{ part{ Envelope, -12.0_dBfs },
+        part{ Envelope, -12.0_dBfs },
+        part{ Envelope, -12.0_dBfs },
+        part{ Envelope, -12.0_dBfs } };
+      for (std::size_t p{ 0 }; p < parts.size(); ++p) {
+        parts[p].play_note(chord_note(p * 2), 0, SamplesPerIteration / FACTOR);
+        parts[p].play_note(chord_note((p * 2) + 1), 0, SamplesPerIteration / FACTOR);
+      }
+      if constexpr (FACTOR == 1) {
+        tmp::mixer<RATE, wavetable_synth, wavetable_synth, wavetable_synth, wavetable_synth> mix{
+          parts[0], parts[1], parts[2], parts[3]
+        };
+        render_samples<BLOCK_SIZE>(mix, buffer);
+      } else {
+        // the parts share a rate, so they are mixed there and upsampled once
+        tmp::mixer<PartRate, wavetable_synth, wavetable_synth, wavetable_synth, wavetable_synth> partMix{
+          parts[0], parts[1], parts[2], parts[3]
+        };
+        tmp::upsampler<FACTOR, decltype(partMix)> mix{ partMix };
+        render_samples<BLOCK_SIZE>(mix, buffer);
+      }
+    });
+    report<RATE, BLOCK_SIZE>("mixer", variant, m);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_mixer()
+  {
+    bench_mixer_parts<RATE, BLOCK_SIZE, 1>("4_sources_2_voices");
+    bench_mixer_parts<RATE, BLOCK_SIZE, 2>("4_sources_2_voices_half_rate");
+    bench_mixer_parts<RATE, BLOCK_SIZE, 4>("4_sources_2_voices_quarter_rate");
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_sequencer_density(std::string_view variant, std::size_t samplesBetweenEvents)
+  {
+    using event = std::tuple<tmp::note, tmp::seconds, tmp::seconds>;
+    std::vector<event> events;
+    auto const rate = static_cast<float>(RATE.samples_per_second);
+    for (std::size_t s{ 0 }; s < SamplesPerIteration; s += samplesBetweenEvents) {
+      auto on = static_cast<float>(s) / rate;
+      events.emplace_back(chord_note(events.size()), tmp::seconds{ on }, tmp::seconds{ on + 0.01F });
+    }
+
+    std::array<float, BLOCK_SIZE.samplesPerBlock> buffer{};
+    auto m = tmp::bench::measure([&] {
+      null_instrument<RATE> instrument;
+      tmp::sequencer sequencer{ instrument };
+      sequencer.queue_events(events);
+      render_samples<BLOCK_SIZE>(sequencer, buffer);
+      tmp::bench::keep(instrument.notes);
+    });
+    report<RATE, BLOCK_SIZE>("sequencer", variant, m);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_sequencer()
+  {
+    bench_sequencer_density<RATE, BLOCK_SIZE>("event_every_256_samples", 256);
+    bench_sequencer_density<RATE, BLOCK_SIZE>("event_every_16_samples", 16);
+    bench_sequencer_density<RATE, BLOCK_SIZE>("event_every_sample", 1);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_wav_renderer()
+  {
+    // long enough for SamplesPerIteration at the slowest rate, rounded up to whole blocks by the renderer
+    using renderer = tmp::wav_renderer_mono<RATE, tmp::seconds{ 2.1F }, BLOCK_SIZE>;
+    auto wav = std::make_unique<renderer>();
+
+    auto m = tmp::bench::measure([&] {
+      tmp::instruments::wavetable_synth<RATE> synth{ Envelope, -12.0_dBfs };
+      for (std::size_t v{ 0 }; v < 8; ++v) {
+        synth.play_note(chord_note(v), 0, renderer::NumSamples);
+      }
+      wav->render(synth);
+      tmp::bench::keep(wav->data[renderer::TotalSize / 2]);
+    });
+
+    // scale to the common per iteration sample count
+    m.nanoseconds_per_iteration *= static_cast<double>(SamplesPerIteration) / renderer::NumSamples;
+    report<RATE, BLOCK_SIZE>("wav_renderer_mono", "wavetable_8_voices", m);
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_parallel_render()
+  {
+    // a long song of overlapping notes, about 8 sounding at once, so each thread gets several segments
+    constexpr std::size_t SongSamples = std::size_t{ 1 } << 20U;
+    using event = std::tuple<tmp::note, tmp::seconds, tmp::seconds>;
+    std::vector<event> events;
+    auto const rate = static_cast<float>(RATE.samples_per_second);
+    for (std::size_t s{ 0 }; s < SongSamples; s += RATE.samples_per_second / 16) {
+      auto on = static_cast<float>(s) / rate;
+      events.emplace_back(chord_note(events.size()), tmp::seconds{ on }, tmp::seconds{ on + 0.5F });
+    }
+    tmp::instruments::wavetable_synth<RATE> synth{ Envelope, -12.0_dBfs };
+    tmp::sequencer song{ synth };
+    song.queue_events(events);
+    std::vector<float> samples(SongSamples);
+
+    for (unsigned threads : { 1U, 2U, 4U, 8U }) {
+      auto m = tmp::bench::measure([&] {
+        tmp::render_parallel<BLOCK_SIZE>(song, synth, samples, threads);
+        tmp::bench::keep(samples[SongSamples / 2]);
+      });
+
+      // scale to the common per iteration sample count
+      m.nanoseconds_per_iteration *= static_cast<double>(SamplesPerIteration) / SongSamples;
+      report<RATE, BLOCK_SIZE>("parallel_render", "wavetable_" + std::to_string(threads) + "_threads", m);
+    }
+  }
+
+  template<tmp::sample_rate RATE, tmp::block_size BLOCK_SIZE>
+  void bench_stages()
+  {
+    if (enabled("oscillator")) {
+      bench_oscillator<RATE, BLOCK_SIZE>();
+    }
+    if (enabled("envelope")) {
+      bench_envelope<RATE, BLOCK_SIZE>();
+    }
+    if (enabled("synth")) {
+      bench_synth<RATE, BLOCK_SIZE>();
+    }
+    if (enabled("mixer")) {
+      bench_mixer<RATE, BLOCK_SIZE>();
+    }
+    if (enabled("sequencer")) {
+      bench_sequencer<RATE, BLOCK_SIZE>();
+    }
+    if (enabled("wav_renderer")) {
+      bench_wav_renderer<RATE, BLOCK_SIZE>();
+    }
+    if (enabled("parallel_render")) {
+      bench_parallel_render<RATE, BLOCK_SIZE>();
+    }
+  }
+
+  template<tmp::sample_rate RATE, std::size_t... BLOCK>
+  void bench_block_sizes(std::index_sequence<BLOCK...>)
+  {
+    (bench_stages<RATE, tmp::block_size{ BlockSizes[BLOCK] }>(), ...);
+  }
+
+  template<std::size_t... RATE>
+  void bench_sample_rates(std::index_sequence<RATE...>)
+  {
+    (bench_block_sizes<tmp::sample_rate{ SampleRates[RATE] }>(std::make_index_sequence<BlockSizes.size()>{}), ...);
+  }
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc > 1) {
+    filter = argv[1];
+  }
+
+  tmp::bench::csv_header();
+  bench_sample_rates(std::make_index_sequence<SampleRates.size()>{});
+  return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Compares scheduling a large score through the sorted timeline (parse_music)
+ * against pushing every event onto the heap one at a time (queue_event).
+ *
+ * The instrument does nothing so only the event handling is measured.
+ */
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "tmp/sequencer.hpp"
+#include "tmp/types.hpp"
+
+namespace {
+  constexpr tmp::sample_rate Rate{ 48'000 };
+  constexpr tmp::block_size BlockSize{ 128 };
+
+  template<tmp::sample_rate RATE>
+  class null_instrument
+  {
+  public:
+    constexpr void play_note(tmp::note, std::uint32_t, std::uint32_t)
+    {
+      ++notes;
+    }
+
+    template<tmp::block_size BLOCK_SIZE>
+    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock>)
+    {}
+
+    std::size_t notes{ 0 };
+  };
+
+  // a piano roll of every note from C2 to B6 with a repeating pattern of short notes
+  auto make_score(std::size_t bars) -> std::string
+  {
+    constexpr std::array<std::string_view, 12> Names{
+      "C ", "C#", "D ", "D#", "E ", "F ", "F#", "G ", "G#", "A ", "A#", "B "
+    };
+    std::string score{ "\n" };
+    for (int octave{ 2 }; octave <= 6; ++octave) {
+      for (std::size_t n{ 0 }; n < Names.size(); ++n) {
+        std::string line;
+        if (Names[n][1] == '#') {
+          line += std::string{ Names[n] } + std::to_string(octave) + "|";
+        } else {
+          line += std::string{ Names[n][0] } + std::to_string(octave) + " |";
+        }
+        for (std::size_t bar{ 0 }; bar < bars; ++bar) {
+          for (std::size_t s{ 0 }; s < 16; ++s) {
+            line += ((s + n + bar + static_cast<std::size_t>(octave)) % 5 == 0) ? "# " : "  ";
+          }
+          line.pop_back();
+          line += " |";
+        }
+        line += '\n';
+        score += line;
+      }
+    }
+    return score;
+  }
+
+  template<bool TIMELINE>
+  auto run(std::string const &score, std::uint32_t blocks) -> std::size_t
+  {
+    auto getMusic = [&] { return tmp::music{ tmp::beats_per_minute{ 480 }, score }; };
+
+    null_instrument<Rate> instrument;
+    tmp::sequencer sequencer{ instrument };
+
+    if constexpr (TIMELINE) {
+      sequencer.parse_music(getMusic);
+    } else {
+      auto music = getMusic();
+      tmp::detail::parser p{ music.bpm, music.source };
+      p.parse_events(
+        [&](tmp::note n, tmp::seconds on, tmp::seconds off) { sequencer.queue_event(n, on, off); });
+    }
+
+    std::array<float, BlockSize.samplesPerBlock> buffer{};
+    for (std::uint32_t b{ 0 }; b < blocks; ++b) {
+      sequencer.template render<BlockSize>(buffer);
+    }
+    return instrument.notes;
+  }
+}  // namespace
+
+
+int main()
+{
+  for (std::size_t bars : { 16U, 64U, 256U }) {
+    auto score = make_score(bars);
+    auto length = tmp::parse_music_length([&] { return tmp::music{ tmp::beats_per_minute{ 480 }, score }; });
+    auto blocks = (length.to_samples(Rate) / BlockSize.samplesPerBlock) + 1;
+
+    auto events = run<true>(score, blocks);
+    auto heap = tmp::bench::measure([&] { tmp::bench::keep(run<false>(score, blocks)); });
+    auto timeline = tmp::bench::measure([&] { tmp::bench::keep(run<true>(score, blocks)); });
+
+    std::printf("%zu bars, %zu events\n", bars, events);
+    tmp::bench::report("  heap (queue_event)", heap);
+    tmp::bench::report("  timeline (parse_music)", timeline);
+  }
+  return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Size, quality and playback cost of the compressed wav_renderer encodings against 16 bit PCM.
+ *
+ * The same arpeggio of wavetable notes is rendered at 8 kHz and 48 kHz with each encoding. Decoding
+ * the whole data chunk back to 16 bit samples a block at a time, as a player would, is then timed;
+ * for PCM16 that is reading the little endian samples. The SNR is measured against the PCM16 render.
+ */
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "tmp/synth.hpp"
+#include "tmp/types.hpp"
+#include "tmp/wav_codec.hpp"
+#include "tmp/wav_render.hpp"
+
+namespace {
+  using namespace tmp::literals;
+
+  constexpr tmp::seconds Length{ 4.0F };
+  constexpr tmp::envelope Envelope{ 0.005_sec, 0.0_dBfs, 0.05_sec, -6.0_dBfs, 0.05_sec };
+  constexpr std::size_t PcmChunk = 512;  // frames read per call when "decoding" PCM16 and G.711
+
+  template<tmp::sample_rate RATE, tmp::wav_encoding ENCODING>
+  using renderer = tmp::wav_renderer_mono<RATE, Length, tmp::block_size{ 128 }, tmp::pcm_dither::None, ENCODING>;
+
+  template<tmp::sample_rate RATE, tmp::wav_encoding ENCODING>
+  auto render() -> std::unique_ptr<renderer<RATE, ENCODING>>
+  {
+    constexpr std::array<std::string_view, 8> Names{ "C3", "E3", "G3", "B3", "D4", "F#4", "A4", "C#5" };
+    constexpr std::uint32_t Notes = 64;
+    constexpr std::uint32_t Step = renderer<RATE, ENCODING>::NumFrames / Notes;
+
+    tmp::instruments::wavetable_synth<RATE> synth{ Envelope, -12.0_dBfs };
+    for (std::uint32_t n{ 0 }; n < Notes; ++n) {
+      synth.play_note(tmp::note{ Names[n % Names.size()] }, n * Step, Step * 4);
+    }
+    auto wav = std::make_unique<renderer<RATE, ENCODING>>();
+    wav->render(synth);
+    return wav;
+  }
+
+  // decode the data chunk of a rendered file to `out`, returning the frames decoded
+  template<typename RENDERER, tmp::wav_encoding ENCODING>
+  auto decode(RENDERER const &wav, std::span<std::int16_t> out) -> std::size_t
+  {
+    std::span<std::byte const> data = std::span{ wav.data }.subspan(RENDERER::HeaderSize);
+    std::size_t frames{ 0 };
+    while (frames < RENDERER::NumFrames) {
+      auto *pcm = out.data() + frames;
+      if constexpr (ENCODING == tmp::wav_encoding::ImaAdpcm) {
+        auto block = data.first(RENDERER::Fmt::BlockAlign);
+        data = data.subspan(RENDERER::Fmt::BlockAlign);
+        frames += tmp::decode_ima_adpcm_block(block, std::span{ pcm, RENDERER::Fmt::SamplesPerBlock });
+      } else if constexpr (ENCODING == tmp::wav_encoding::Pcm16) {
+        auto const count = std::min(PcmChunk, RENDERER::NumFrames - frames);
+        auto const *in = data.data() + (frames * 2);
+        for (std::size_t i{ 0 }; i < count; ++i) {
+          pcm[i] = tmp::detail::load_pcm16(in + (i * 2));
+        }
+        frames += count;
+      } else {
+        auto const count = std::min(PcmChunk, RENDERER::NumFrames - frames);
+        frames += tmp::decode_g711<ENCODING>(data.subspan(frames, count), std::span{ pcm, count });
+      }
+    }
+    return frames;
+  }
+
+  template<tmp::sample_rate RATE, tmp::wav_encoding ENCODING>
+  void bench_encoding(std::string_view name, std::vector<std::int16_t> const &reference)
+  {
+    using wav_type = renderer<RATE, ENCODING>;
+    auto wav = render<RATE, ENCODING>();
+
+    // room for a whole final ADPCM block
+    std::vector<std::int16_t> decoded(wav_type::NumFrames + wav_type::Fmt::SamplesPerBlock);
+    decode<wav_type, ENCODING>(*wav, decoded);
+
+    double signal{ 0.0 };
+    double error{ 0.0 };
+    for (std::size_t i{ 0 }; i < reference.size(); ++i) {
+      auto const difference = static_cast<double>(reference[i]) - decoded[i];
+      signal += static_cast<double>(reference[i]) * reference[i];
+      error += difference * difference;
+    }
+    auto const snr = error == 0.0 ? INFINITY : 10.0 * std::log10(signal / error);
+
+    auto m = tmp::bench::measure([&] {
+      tmp::bench::keep(decode<wav_type, ENCODING>(*wav, decoded));
+      tmp::bench::keep(decoded.data());
+    });
+
+    std::printf("  %-10.*s %10u %7.2f %8.1f dB %12.3f\n",
+      static_cast<int>(name.size()),
+      name.data(),
+      wav_type::SampleDataLength,
+      static_cast<double>(renderer<RATE, tmp::wav_encoding::Pcm16>::SampleDataLength) / wav_type::SampleDataLength,
+      snr,
+      m.nanoseconds_per_iteration / wav_type::NumFrames);
+  }
+
+  template<tmp::sample_rate RATE>
+  void bench_rate()
+  {
+    using pcm_type = renderer<RATE, tmp::wav_encoding::Pcm16>;
+    auto pcm = render<RATE, tmp::wav_encoding::Pcm16>();
+    std::vector<std::int16_t> reference(pcm_type::NumFrames + 1);
+    decode<pcm_type, tmp::wav_encoding::Pcm16>(*pcm, reference);
+    reference.resize(pcm_type::NumFrames);
+
+    std::printf("%u Hz, %u samples\n", RATE.samples_per_second, pcm_type::NumFrames);
+    std::printf("  %-10s %10s %7s %11s %12s\n", "encoding", "data bytes", "ratio", "SNR", "decode ns/sample");
+    bench_encoding<RATE, tmp::wav_encoding::Pcm16>("pcm16", reference);
+    bench_encoding<RATE, tmp::wav_encoding::ImaAdpcm>("ima_adpcm", reference);
+    bench_encoding<RATE, tmp::wav_encoding::MuLaw>("mu_law", reference);
+    bench_encoding<RATE, tmp::wav_encoding::ALaw>("a_law", reference);
+  }
+}  // namespace
+
+
+int main()
+{
+  bench_rate<tmp::sample_rate{ 8'000 }>();
+  bench_rate<tmp::sample_rate{ 48'000 }>();
+  return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "types.hpp"
+
+namespace tmp {
+
+  struct event_inbox_stats
+  {
+    std::uint64_t pushed{ 0 };
+    std::uint64_t rejected{ 0 };  // push() found the inbox full or the note number above 127
+    std::uint64_t merged{ 0 };  // taken into a sequencer's schedule
+    std::uint64_t late{ 0 };  // arrived after their note on sample had been rendered, played at the next block
+    std::uint32_t maxLateSamples{ 0 };
+  };
+
+  //
+  // Lock free inbox for events played live from other threads, the render thread merges them into a
+  // sequencer's schedule at the start of each block (see sequencer::attach_inbox).
+  //
+  // Any number of threads may push(), only the sequencer pops. This is a bounded queue of cells that
+  // each carry a sequence number (Dmitry Vyukov's design): a producer claims a cell with one compare
+  // exchange on the enqueue position, writes the event and then releases the cell's sequence, so the
+  // consumer never sees a half written event. Storage is allocated once, here in the constructor.
+  //
+  // Events are stamped with the sample number they should start on. position() is where the sequencer
+  // will render from next, so `position()` itself is on time unless that block starts rendering before
+  // the event is pushed, a lookahead of one block avoids that. An event that arrives too late plays at
+  // the start of the next block and is counted in stats().
+  //
+  //   event_inbox inbox{ 1024 };
+  //   sequencer.attach_inbox(inbox);
+  //   // any thread
+  //   inbox.push(note{ "C4" }, inbox.position() + 256, 4800);
+  //
+  class event_inbox
+  {
+  public:
+    // rounded up to a power of 2
+    explicit event_inbox(std::size_t capacity)
+      : m_capacity{ std::bit_ceil(std::max<std::size_t>(capacity, 2)) }
+      , m_cells{ std::make_unique<cell[]>(m_capacity) }  // NOLINT(*-avoid-c-arrays)
+    {
+      for (std::size_t i{ 0 }; i < m_capacity; ++i) {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    event_inbox(event_inbox const &) = delete;
+    auto operator=(event_inbox const &) -> event_inbox & = delete;
+
+    // any thread, false when the inbox is full or the event is not a MIDI note
+    auto push(compact_event event) -> bool
+    {
+      if (event.noteNumber > MaxNoteNumber) {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+
+      auto position = m_enqueue.load(std::memory_order_relaxed);
+      cell *claimed{ nullptr };
+      while (claimed == nullptr) {
+        auto &candidate = m_cells[position & (m_capacity - 1)];
+        auto const sequence = candidate.sequence.load(std::memory_order_acquire);
+        auto const difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (difference == 0) {
+          if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            claimed = &candidate;
+          }
+        } else if (difference < 0) {
+          m_rejected.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        } else {
+          position = m_enqueue.load(std::memory_order_relaxed);  // another producer took this cell
+        }
+      }
+
+      claimed->event = event;
+      claimed->sequence.store(position + 1, std::memory_order_release);
+      m_pushed.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    auto push(note n, std::uint32_t noteOnSample, std::uint32_t lengthSamples) -> bool
+    {
+      return push(compact_event{ static_cast<std::uint8_t>(n.note_number), noteOnSample, lengthSamples });
+    }
+
+    // the first sample of the next block the sequencer renders
+    [[nodiscard]] auto position() const -> std::uint32_t
+    {
+      return m_position.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] auto capacity() const -> std::size_t
+    {
+      return m_capacity;
+    }
+
+    [[nodiscard]] auto stats() const -> event_inbox_stats
+    {
+      return event_inbox_stats{ m_pushed.load(std::memory_order_relaxed),
+        m_rejected.load(std::memory_order_relaxed),
+        m_merged.load(std::memory_order_relaxed),
+        m_late.load(std::memory_order_relaxed),
+        m_maxLateSamples.load(std::memory_order_relaxed) };
+    }
+
+    // The render thread only, used by the sequencer
+
+    auto pop(compact_event &event) -> bool
+    {
+      auto &next = m_cells[m_dequeue & (m_capacity - 1)];
+      if (next.sequence.load(std::memory_order_acquire) != m_dequeue + 1) {
+        return false;  // empty, or the producer of the next cell has not finished writing it
+      }
+      event = next.event;
+      next.sequence.store(m_dequeue + m_capacity, std::memory_order_release);
+      ++m_dequeue;
+      return true;
+    }
+
+    void set_position(std::uint32_t sampleNumber)
+    {
+      m_position.store(sampleNumber, std::memory_order_release);
+    }
+
+    void record_merge(std::uint32_t lateSamples)
+    {
+      m_merged.store(m_merged.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (lateSamples > 0) {
+        m_late.store(m_late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (lateSamples > m_maxLateSamples.load(std::memory_order_relaxed)) {
+          m_maxLateSamples.store(lateSamples, std::memory_order_relaxed);
+        }
+      }
+    }
+
+  private:
+    static constexpr std::uint8_t MaxNoteNumber{ 127 };
+
+    struct cell
+    {
+      std::atomic<std::size_t> sequence;
+      compact_event event;
+    };
+
+    std::size_t m_capacity;
+    std::unique_ptr<cell[]> m_cells;  // NOLINT(*-avoid-c-arrays)
+    alignas(64) std::atomic<std::size_t> m_enqueue{ 0 };
+    alignas(64) std::size_t m_dequeue{ 0 };
+    std::atomic<std::uint32_t> m_position{ 0 };
+    // counters, written by producers (pushed, rejected) or the render thread only (the rest)
+    std::atomic<std::uint64_t> m_pushed{ 0 };
+    std::atomic<std::uint64_t> m_rejected{ 0 };
+    std::atomic<std::uint64_t> m_merged{ 0 };
+    std::atomic<std::uint64_t> m_late{ 0 };
+    std::atomic<std::uint32_t> m_maxLateSamples{ 0 };
+  };
+
+}  // namespace tmp
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "sources.hpp"
+#include "types.hpp"
+
+namespace tmp::instruments {
+
+  // Whether a synth_base renders every note itself or renders each distinct note once and replays it
+  enum class note_caching : std::uint8_t {
+    None,
+    Memoize
+  };
+
+  struct note_cache_stats
+  {
+    std::size_t hits{ 0 };  // notes played from an already rendered buffer
+    std::size_t misses{ 0 };  // distinct notes rendered into the cache
+  };
+
+  //
+  // Every note starts its oscillator at phase 0 on the note on sample, so within one synth (one envelope
+  // and volume) two notes with the same frequency and length produce the same samples. The cache renders
+  // each distinct note once, from the note on to the end of its release, and later occurrences are mixed
+  // from that buffer at their own offset. This works the same during constant evaluation and at run time.
+  //
+  // With wavetable_oscillator replayed notes match a directly rendered note up to float rounding (envelope
+  // ramps are split where the blocks fall). sin_oscillator accumulates a float angle, so a long note drifts
+  // a little differently depending on where in a block it started.
+  //
+  template<sample_rate RATE, template<sample_rate> typename OSCILLATOR>
+  class note_cache
+  {
+  public:
+    constexpr note_cache(envelope env, volume vol)
+      : m_envelope{ env }
+      , m_volume{ vol }
+    {}
+
+    // the index of the rendered note, rendering it first if this is the first time it is played
+    constexpr auto find_or_render(frequency noteFrequency, std::uint32_t length) -> std::size_t
+    {
+      key const wanted{ noteFrequency.hertz, length, 0 };
+      auto found = std::ranges::lower_bound(m_keys, wanted, key::less);
+      if (found != m_keys.end() and found->hertz == wanted.hertz and found->length == wanted.length) {
+        ++m_stats.hits;
+        return found->index;
+      }
+
+      ++m_stats.misses;
+      auto index = m_notes.size();
+      m_notes.push_back(render_note(noteFrequency, length));
+      m_keys.insert(found, key{ wanted.hertz, wanted.length, index });
+      return index;
+    }
+
+    // the note from its note on sample to the end of the release
+    [[nodiscard]] constexpr auto samples(std::size_t index) const -> std::span<float const>
+    {
+      return m_notes[index];
+    }
+
+    [[nodiscard]] constexpr auto stats() const -> note_cache_stats
+    {
+      return m_stats;
+    }
+
+  private:
+    using Note = sources::note_base<RATE, OSCILLATOR>;
+
+    struct key
+    {
+      float hertz;
+      std::uint32_t length;
+      std::size_t index;
+
+      static constexpr auto less(key const &lhs, key const &rhs) -> bool
+      {
+        return lhs.hertz < rhs.hertz or (lhs.hertz == rhs.hertz and lhs.length < rhs.length);
+      }
+    };
+
+    envelope m_envelope;
+    volume m_volume;
+    std::vector<std::vector<float>> m_notes{};  // in the order they were first played
+    std::vector<key> m_keys{};  // sorted by frequency then length
+    note_cache_stats m_stats{};
+
+    [[nodiscard]] constexpr auto render_note(frequency noteFrequency, std::uint32_t length) const
+      -> std::vector<float>
+    {
+      Note note{ m_envelope, 0, length, noteFrequency, m_volume };
+      std::vector<float> samples;
+      std::array<float, detail::ScratchSamples> buffer;
+      while (!note.is_idle()) {
+        note.render(std::span<float>{ buffer });
+        samples.insert(samples.end(), buffer.begin(), buffer.end());
+      }
+      return samples;
+    }
+  };
+
+}  // namespace tmp::instruments
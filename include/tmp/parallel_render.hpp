@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "sequencer.hpp"
+#include "types.hpp"
+
+namespace tmp {
+
+  //
+  // Offline render of a sequenced song across several threads.
+  //
+  // The output is cut into segments of whole blocks. Each segment gets its own copy of the (unplayed)
+  // instrument and of the sequencer's events, seeks to the segment start, which resumes any notes
+  // still sounding there including release tails, and renders straight into its slice of the output.
+  // Voices are independent and oscillator phase is derived from the note on time, so with a fixed point
+  // oscillator (wavetable_oscillator) the result matches the serial render exactly, apart from an envelope
+  // resumed part way through a ramp rounding differently (below 1e-6). sin_oscillator accumulates a float
+  // phase, which a seek rounds differently, so it only matches to about 12 LSB over 8 seconds.
+  //
+  //   sin_synth<Rate> synth{ ... };
+  //   sequencer song{ synth };
+  //   song.parse_music(musicSource);
+  //   std::vector<float> samples(length.to_samples(Rate));
+  //   render_parallel(song, synth, samples);
+  //
+  template<block_size BLOCK_SIZE = block_size{ 128 }, sample_rate RATE, template<sample_rate> typename INSTRUMENT>
+  void render_parallel(sequencer<RATE, INSTRUMENT> const &song,
+    INSTRUMENT<RATE> const &instrument,
+    std::span<float> output,
+    unsigned threads = std::thread::hardware_concurrency())
+  {
+    constexpr std::size_t Block = BLOCK_SIZE.samplesPerBlock;
+    constexpr std::size_t MinimumSegmentBlocks = 64;  // keeps the cost of seeking small
+    constexpr std::size_t SegmentsPerThread = 4;  // spare segments to even out the load
+
+    threads = std::max(1U, threads);
+    std::size_t const totalBlocks = (output.size() + Block - 1) / Block;
+    std::size_t const wantedSegments = std::size_t{ threads } * SegmentsPerThread;
+    std::size_t const segmentBlocks =
+      std::max(MinimumSegmentBlocks, (totalBlocks + wantedSegments - 1) / wantedSegments);
+    std::size_t const segments = (totalBlocks + segmentBlocks - 1) / segmentBlocks;
+
+    auto renderSegment = [&](std::size_t segment) {
+      auto voices = instrument;
+      sequencer<RATE, INSTRUMENT> part{ song, voices };
+
+      std::size_t const first = segment * segmentBlocks * Block;
+      std::size_t const last = std::min(output.size(), first + (segmentBlocks * Block));
+      part.seek(static_cast<std::uint32_t>(first));
+
+      for (std::size_t start{ first }; start < last; start += Block) {
+        if (start + Block <= last) {
+          part.template render<BLOCK_SIZE>(std::span<float, Block>{ output.data() + start, Block });
+        } else {
+          part.render(output.subspan(start, last - start));  // partial block at the end of the output
+        }
+      }
+    };
+
+    std::atomic<std::size_t> nextSegment{ 0 };
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto worker = [&] {
+      for (auto segment = nextSegment++; segment < segments; segment = nextSegment++) {
+        try {
+          renderSegment(segment);
+        } catch (...) {
+          std::scoped_lock lock{ failureMutex };
+          if (!failure) {
+            failure = std::current_exception();
+          }
+        }
+      }
+    };
+
+    {
+      std::vector<std::jthread> pool;
+      pool.reserve(threads - 1);
+      for (unsigned t{ 1 }; t < std::min<std::size_t>(threads, segments); ++t) {
+        pool.emplace_back(worker);
+      }
+      worker();  // this thread works too
+    }  // join
+
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+  }
+
+}  // namespace tmp
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#endif
+
+namespace tmp {
+
+  // Optional dither applied when reducing float samples to 16 bit PCM
+  enum class pcm_dither : std::uint8_t {
+    None,  // truncate, as the original encoder
+    Tpdf  // add triangular +/-1 LSB noise then round, removes quantisation distortion on quiet signals
+  };
+
+  namespace detail {
+    //
+    // Triangular probability density noise in LSB units, the sum of two uniform values.
+    // Uses a xorshift generator so it is deterministic and usable during constant evaluation.
+    //
+    class tpdf_noise
+    {
+    public:
+      constexpr auto next() -> float
+      {
+        return uniform() - uniform();
+      }
+
+    private:
+      std::uint32_t m_state{ 0x9E3779B9U };
+
+      constexpr auto uniform() -> float
+      {
+        m_state ^= m_state << 13U;
+        m_state ^= m_state >> 17U;
+        m_state ^= m_state << 5U;
+        return static_cast<float>(m_state >> 8U) * (1.0F / 16777216.0F);  // [0, 1)
+      }
+    };
+
+    constexpr float Pcm16Scale = std::numeric_limits<std::int16_t>::max();
+
+    constexpr static void store_pcm16(std::byte *out, std::int32_t value)
+    {
+      auto data = static_cast<std::uint16_t>(static_cast<std::int16_t>(value));
+      out[0] = static_cast<std::byte>(data & 0xFFU);
+      out[1] = static_cast<std::byte>(static_cast<std::uint16_t>(data >> 8U) & 0xFFU);
+    }
+
+    // Quantise one sample, truncating toward zero or, with dither, adding the noise and rounding half away from zero
+    constexpr static auto quantise_pcm16(float sample, float const *noise) -> std::int32_t
+    {
+      auto scaled = std::clamp(sample, -1.0F, 1.0F) * Pcm16Scale;
+      if (noise == nullptr) {
+        return static_cast<std::int32_t>(scaled);
+      }
+      scaled += *noise;
+      auto value = static_cast<std::int32_t>(scaled + (scaled < 0.0F ? -0.5F : 0.5F));
+      return std::clamp<std::int32_t>(
+        value, std::numeric_limits<std::int16_t>::min(), std::numeric_limits<std::int16_t>::max());
+    }
+
+    // Reference encoder, used during constant evaluation and for the tail of a run time block.
+    constexpr static void encode_pcm16_scalar(float const *samples,
+      float const *noise,
+      std::byte *out,
+      std::size_t count)
+    {
+      for (std::size_t i{ 0 }; i < count; ++i) {
+        store_pcm16(out + (i * 2), quantise_pcm16(samples[i], noise == nullptr ? nullptr : noise + i));
+      }
+    }
+
+    // As above for a planar left / right pair, written out interleaved as frames of L R
+    constexpr static void encode_pcm16_stereo_scalar(float const *left,
+      float const *right,
+      float const *noiseLeft,
+      float const *noiseRight,
+      std::byte *out,
+      std::size_t frames)
+    {
+      for (std::size_t i{ 0 }; i < frames; ++i) {
+        store_pcm16(out + (i * 4), quantise_pcm16(left[i], noiseLeft == nullptr ? nullptr : noiseLeft + i));
+        store_pcm16(out + (i * 4) + 2, quantise_pcm16(right[i], noiseRight == nullptr ? nullptr : noiseRight + i));
+      }
+    }
+
+#if defined(__SSE2__)
+    // clamp, scale, (dither and round) then truncate 4 samples to int32, same arithmetic as the scalar path
+    inline auto convert_pcm16x4(__m128 x, float const *noise) -> __m128i
+    {
+      x = _mm_mul_ps(_mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.0F)), _mm_set1_ps(1.0F)), _mm_set1_ps(Pcm16Scale));
+      if (noise != nullptr) {
+        x = _mm_add_ps(x, _mm_loadu_ps(noise));
+        auto half = _mm_or_ps(_mm_set1_ps(0.5F), _mm_and_ps(x, _mm_set1_ps(-0.0F)));  // +/-0.5 with x's sign
+        x = _mm_add_ps(x, half);
+      }
+      return _mm_cvttps_epi32(x);
+    }
+
+    // returns the number of samples encoded, the remainder is left for the scalar path
+    inline auto encode_pcm16_simd(float const *samples, float const *noise, std::byte *out, std::size_t count)
+      -> std::size_t
+    {
+      std::size_t i{ 0 };
+      for (; i + 8 <= count; i += 8) {
+        auto lo = convert_pcm16x4(_mm_loadu_ps(samples + i), noise == nullptr ? nullptr : noise + i);
+        auto hi = convert_pcm16x4(_mm_loadu_ps(samples + i + 4), noise == nullptr ? nullptr : noise + i + 4);
+        // saturating pack, x86 is little endian so the int16 lanes are already in file order
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + (i * 2)), _mm_packs_epi32(lo, hi));  // NOLINT
+      }
+      return i;
+    }
+
+    // stereo version, the two planar channels are packed to int16 then interleaved with unpack
+    inline auto encode_pcm16_stereo_simd(float const *left,
+      float const *right,
+      float const *noiseLeft,
+      float const *noiseRight,
+      std::byte *out,
+      std::size_t frames) -> std::size_t
+    {
+      auto offset = [](float const *noise, std::size_t i) { return noise == nullptr ? nullptr : noise + i; };
+
+      std::size_t i{ 0 };
+      for (; i + 8 <= frames; i += 8) {
+        auto l = _mm_packs_epi32(convert_pcm16x4(_mm_loadu_ps(left + i), offset(noiseLeft, i)),
+          convert_pcm16x4(_mm_loadu_ps(left + i + 4), offset(noiseLeft, i + 4)));
+        auto r = _mm_packs_epi32(convert_pcm16x4(_mm_loadu_ps(right + i), offset(noiseRight, i)),
+          convert_pcm16x4(_mm_loadu_ps(right + i + 4), offset(noiseRight, i + 4)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + (i * 4)), _mm_unpacklo_epi16(l, r));  // NOLINT
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + (i * 4) + 16), _mm_unpackhi_epi16(l, r));  // NOLINT
+      }
+      return i;
+    }
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    inline auto convert_pcm16x4(float32x4_t x, float const *noise) -> int32x4_t
+    {
+      x = vmulq_n_f32(vminq_f32(vmaxq_f32(x, vdupq_n_f32(-1.0F)), vdupq_n_f32(1.0F)), Pcm16Scale);
+      if (noise != nullptr) {
+        x = vaddq_f32(x, vld1q_f32(noise));
+        auto sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000U));
+        auto half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5F)), sign));
+        x = vaddq_f32(x, half);
+      }
+      return vcvtq_s32_f32(x);  // truncates toward zero
+    }
+
+    inline auto encode_pcm16_simd(float const *samples, float const *noise, std::byte *out, std::size_t count)
+      -> std::size_t
+    {
+      std::size_t i{ 0 };
+      for (; i + 8 <= count; i += 8) {
+        auto lo = convert_pcm16x4(vld1q_f32(samples + i), noise == nullptr ? nullptr : noise + i);
+        auto hi = convert_pcm16x4(vld1q_f32(samples + i + 4), noise == nullptr ? nullptr : noise + i + 4);
+        vst1q_s16(reinterpret_cast<std::int16_t *>(out + (i * 2)), vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));  // NOLINT
+      }
+      return i;
+    }
+
+    // stereo version, vst2 interleaves the two channels as it stores
+    inline auto encode_pcm16_stereo_simd(float const *left,
+      float const *right,
+      float const *noiseLeft,
+      float const *noiseRight,
+      std::byte *out,
+      std::size_t frames) -> std::size_t
+    {
+      auto offset = [](float const *noise, std::size_t i) { return noise == nullptr ? nullptr : noise + i; };
+
+      std::size_t i{ 0 };
+      for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t lr{};
+        lr.val[0] = vcombine_s16(vqmovn_s32(convert_pcm16x4(vld1q_f32(left + i), offset(noiseLeft, i))),
+          vqmovn_s32(convert_pcm16x4(vld1q_f32(left + i + 4), offset(noiseLeft, i + 4))));
+        lr.val[1] = vcombine_s16(vqmovn_s32(convert_pcm16x4(vld1q_f32(right + i), offset(noiseRight, i))),
+          vqmovn_s32(convert_pcm16x4(vld1q_f32(right + i + 4), offset(noiseRight, i + 4))));
+        vst2q_s16(reinterpret_cast<std::int16_t *>(out + (i * 4)), lr);  // NOLINT
+      }
+      return i;
+    }
+#else
+    inline auto encode_pcm16_simd(float const *, float const *, std::byte *, std::size_t) -> std::size_t
+    {
+      return 0;
+    }
+
+    inline auto encode_pcm16_stereo_simd(float const *,
+      float const *,
+      float const *,
+      float const *,
+      std::byte *,
+      std::size_t) -> std::size_t
+    {
+      return 0;
+    }
+#endif
+
+    // encode samples to signed 16 bit little endian PCM, anything beyond +/-1.0F is clamped
+    constexpr static void encode_pcm16(std::span<float const> samples, std::span<std::byte> buffer)
+    {
+      std::size_t done{ 0 };
+      if !consteval {
+        done = encode_pcm16_simd(samples.data(), nullptr, buffer.data(), samples.size());
+      }
+      encode_pcm16_scalar(samples.data() + done, nullptr, buffer.data() + (done * 2), samples.size() - done);
+    }
+
+    // as above with TPDF dither, the noise is generated in small batches so the conversion stays vectorised
+    constexpr static void encode_pcm16(std::span<float const> samples, std::span<std::byte> buffer, tpdf_noise &dither)
+    {
+      constexpr std::size_t Batch = 64;
+      std::array<float, Batch> noise{};
+
+      for (std::size_t start{ 0 }; start < samples.size(); start += Batch) {
+        auto count = std::min(Batch, samples.size() - start);
+        for (std::size_t i{ 0 }; i < count; ++i) {
+          noise[i] = dither.next();
+        }
+
+        std::size_t done{ 0 };
+        if !consteval {
+          done = encode_pcm16_simd(samples.data() + start, noise.data(), buffer.data() + (start * 2), count);
+        }
+        encode_pcm16_scalar(
+          samples.data() + start + done, noise.data() + done, buffer.data() + ((start + done) * 2), count - done);
+      }
+    }
+
+    // encode a planar stereo pair to interleaved signed 16 bit little endian PCM, `buffer` holds 2 samples per frame.
+    // Passing the same span for both channels writes a mono block to both without copying it.
+    constexpr static void encode_pcm16_stereo(std::span<float const> left,
+      std::span<float const> right,
+      std::span<std::byte> buffer)
+    {
+      std::size_t done{ 0 };
+      if !consteval {
+        done = encode_pcm16_stereo_simd(left.data(), right.data(), nullptr, nullptr, buffer.data(), left.size());
+      }
+      encode_pcm16_stereo_scalar(
+        left.data() + done, right.data() + done, nullptr, nullptr, buffer.data() + (done * 4), left.size() - done);
+    }
+
+    // as above with TPDF dither, each channel gets its own noise
+    constexpr static void encode_pcm16_stereo(std::span<float const> left,
+      std::span<float const> right,
+      std::span<std::byte> buffer,
+      tpdf_noise &dither)
+    {
+      constexpr std::size_t Batch = 64;
+      std::array<float, Batch> noiseLeft{};
+      std::array<float, Batch> noiseRight{};
+
+      for (std::size_t start{ 0 }; start < left.size(); start += Batch) {
+        auto count = std::min(Batch, left.size() - start);
+        for (std::size_t i{ 0 }; i < count; ++i) {
+          noiseLeft[i] = dither.next();
+          noiseRight[i] = dither.next();
+        }
+
+        std::size_t done{ 0 };
+        if !consteval {
+          done = encode_pcm16_stereo_simd(left.data() + start,
+            right.data() + start,
+            noiseLeft.data(),
+            noiseRight.data(),
+            buffer.data() + (start * 4),
+            count);
+        }
+        encode_pcm16_stereo_scalar(left.data() + start + done,
+          right.data() + start + done,
+          noiseLeft.data() + done,
+          noiseRight.data() + done,
+          buffer.data() + ((start + done) * 4),
+          count - done);
+      }
+    }
+  }  // namespace detail
+
+}  // namespace tmp
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <unistd.h>
+
+#include "pcm_encode.hpp"
+#include "types.hpp"
+
+namespace tmp {
+
+  namespace detail {
+    // not std::hardware_destructive_interference_size, GCC warns it may differ between translation units
+    constexpr std::size_t CacheLine = 64;
+
+    //
+    // Wait free single producer, single consumer ring of CAPACITY slots. The producer fills the slot
+    // from begin_push() in place and then publish()es it, the consumer reads front() and then pop()s
+    // it. Each side only stores its own index, and the two indices live on separate cache lines.
+    //
+    template<typename T, std::size_t CAPACITY>
+    class spsc_ring
+    {
+      static_assert(CAPACITY >= 2 and std::has_single_bit(CAPACITY), "Ring capacity must be a power of 2");
+
+    public:
+      // producer: the next slot to fill, nullptr when the ring is full
+      [[nodiscard]] auto begin_push() -> T *
+      {
+        auto const head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == CAPACITY) {
+          return nullptr;
+        }
+        return &m_slots[head & Mask];
+      }
+
+      void publish()
+      {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+
+      // consumer: the oldest published slot, nullptr when the ring is empty
+      [[nodiscard]] auto front() -> T *
+      {
+        auto const tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail) {
+          return nullptr;
+        }
+        return &m_slots[tail & Mask];
+      }
+
+      void pop()
+      {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+
+      // exact from either side for its own view, approximate from anywhere else
+      [[nodiscard]] auto size() const -> std::size_t
+      {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+      }
+
+      // drop every published slot, only while neither side is running
+      void clear()
+      {
+        m_tail.store(m_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      }
+
+    private:
+      static constexpr std::size_t Mask = CAPACITY - 1;
+
+      alignas(CacheLine) std::atomic<std::size_t> m_head{ 0 };
+      alignas(CacheLine) std::atomic<std::size_t> m_tail{ 0 };
+      alignas(CacheLine) std::array<T, CAPACITY> m_slots{};
+    };
+  }  // namespace detail
+
+
+  //
+  // Writes raw 16 bit little endian PCM to a file descriptor, a file or a pipe into a player:
+  //
+  //   prog | aplay -f S16_LE -r 48000 -c 1
+  //
+  // Errors are thrown as std::system_error, the engine stops writing and rethrows them from stop().
+  //
+  class fd_sink
+  {
+  public:
+    // does not take ownership of the file descriptor
+    explicit fd_sink(int fd)
+      : m_fd{ fd }
+    {}
+
+    void operator()(std::span<std::byte const> data) const
+    {
+      while (!data.empty()) {
+        auto written = ::write(m_fd, data.data(), data.size());
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::system_error{ errno, std::generic_category(), "writing PCM data" };
+        }
+        data = data.subspan(static_cast<std::size_t>(written));
+      }
+    }
+
+  private:
+    int m_fd;
+  };
+
+
+  struct realtime_stats
+  {
+    std::uint64_t blocksRendered{ 0 };
+    std::uint64_t blocksPlayed{ 0 };
+    std::uint64_t underruns{ 0 };  // blocks played as silence because the render thread fell behind
+    std::chrono::nanoseconds blockPeriod{ 0 };
+    std::chrono::nanoseconds meanRenderTime{ 0 };
+    std::chrono::nanoseconds maxRenderTime{ 0 };
+    std::chrono::nanoseconds minHeadroom{ 0 };  // block period less the slowest render, negative is too slow
+    std::chrono::nanoseconds meanLatency{ 0 };  // from the start of rendering a block until it is played
+    std::chrono::nanoseconds maxLatency{ 0 };
+  };
+
+  //
+  // Plays a source live. A render thread renders blocks into a wait free ring of RING_BLOCKS blocks
+  // and an audio thread takes one block per block period, on a steady clock, encodes it to 16 bit
+  // PCM and hands it to the SINK, any callable taking std::span<std::byte const>. If no block is
+  // ready in time the audio thread plays silence and counts an underrun.
+  //
+  // The audio thread does not allocate or lock, the ring is preallocated and only uses atomics.
+  // Playback starts once the ring is full, so the latency is about RING_BLOCKS block periods and
+  // the render thread has that much slack for a slow block.
+  //
+  //   realtime_engine<Rate> engine{ fd_sink{ STDOUT_FILENO } };
+  //   engine.play(sequencer, seconds{ 10.0F });
+  //   auto stats = engine.stats();
+  //
+  // Mono only, a stereo_source plays its render() output.
+  //
+  template<sample_rate RATE,
+    typename SINK = fd_sink,
+    block_size BLOCK_SIZE = block_size{ 128 },
+    std::size_t RING_BLOCKS = 8>
+  class realtime_engine
+  {
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::size_t Block = BLOCK_SIZE.samplesPerBlock;
+
+  public:
+    static constexpr std::chrono::nanoseconds BlockPeriod{ (std::uint64_t{ Block } * 1'000'000'000U)
+                                                           / RATE.samples_per_second };
+    static constexpr std::uint64_t Forever = std::numeric_limits<std::uint64_t>::max();
+
+    explicit realtime_engine(SINK sink)
+      : m_sink{ std::move(sink) }
+    {}
+
+    realtime_engine(realtime_engine const &) = delete;
+    auto operator=(realtime_engine const &) -> realtime_engine & = delete;
+
+    ~realtime_engine()
+    {
+      try {
+        stop();
+      } catch (...) {  // NOLINT(bugprone-empty-catch) destructors must not throw, call stop() to see errors
+      }
+    }
+
+    // start rendering and playing `blocks` blocks of the source, it must outlive the playback
+    template<typename SOURCE>
+    void start(SOURCE &source, std::uint64_t blocks = Forever)
+    {
+      if (m_renderer.joinable() or m_player.joinable()) {
+        throw std::logic_error{ "realtime_engine is already playing" };
+      }
+      m_ring.clear();  // blocks rendered ahead before the last stop() are stale
+      m_renderDone.store(false);
+      m_playDone.store(false);
+      m_renderer =
+        std::jthread{ [this, &source, blocks](std::stop_token const &stop) { render_loop(stop, source, blocks); } };
+      m_player = std::jthread{ [this](std::stop_token const &stop) { play_loop(stop); } };
+    }
+
+    // play whole blocks covering `length` and return once they have all been played
+    template<typename SOURCE>
+    void play(SOURCE &source, seconds length)
+    {
+      start(source, (length.to_samples(RATE) + Block - 1) / Block);
+      wait();
+      stop();
+    }
+
+    // block until every rendered block has been played, only returns for a finite number of blocks
+    void wait() const
+    {
+      m_playDone.wait(false);
+    }
+
+    // stop both threads, rethrowing an error from the sink
+    void stop()
+    {
+      m_renderer = std::jthread{};  // requests stop and joins
+      m_player = std::jthread{};
+      if (auto error = std::exchange(m_error, nullptr)) {
+        std::rethrow_exception(error);
+      }
+    }
+
+    // totals since the engine was constructed, may be called while playing
+    [[nodiscard]] auto stats() const -> realtime_stats
+    {
+      auto const rendered = m_blocksRendered.load(std::memory_order_relaxed);
+      auto const consumed = m_blocksConsumed.load(std::memory_order_relaxed);
+      auto const maxRender = std::chrono::nanoseconds{ m_maxRenderNs.load(std::memory_order_relaxed) };
+
+      realtime_stats result{};
+      result.blocksRendered = rendered;
+      result.blocksPlayed = m_blocksPlayed.load(std::memory_order_relaxed);
+      result.underruns = m_underruns.load(std::memory_order_relaxed);
+      result.blockPeriod = BlockPeriod;
+      result.maxRenderTime = maxRender;
+      result.minHeadroom = BlockPeriod - maxRender;
+      result.maxLatency = std::chrono::nanoseconds{ m_maxLatencyNs.load(std::memory_order_relaxed) };
+      if (rendered > 0) {
+        result.meanRenderTime =
+          std::chrono::nanoseconds{ m_totalRenderNs.load(std::memory_order_relaxed) / rendered };
+      }
+      if (consumed > 0) {
+        result.meanLatency =
+          std::chrono::nanoseconds{ m_totalLatencyNs.load(std::memory_order_relaxed) / consumed };
+      }
+      return result;
+    }
+
+    [[nodiscard]] auto sink() -> SINK &
+    {
+      return m_sink;
+    }
+
+  private:
+    struct slot
+    {
+      std::array<float, Block> samples;
+      Clock::time_point renderStart;
+    };
+
+    SINK m_sink;
+    detail::spsc_ring<slot, std::bit_ceil(RING_BLOCKS)> m_ring{};
+    std::array<std::byte, Block * 2> m_pcm{};  // audio thread only
+
+    std::atomic<bool> m_renderDone{ false };
+    std::atomic<bool> m_playDone{ false };
+    std::exception_ptr m_error;  // from the sink, written by the audio thread and read by stop() once it has joined
+
+    // written by one thread each, read by stats()
+    std::atomic<std::uint64_t> m_blocksRendered{ 0 };
+    std::atomic<std::uint64_t> m_totalRenderNs{ 0 };
+    std::atomic<std::int64_t> m_maxRenderNs{ 0 };
+    std::atomic<std::uint64_t> m_blocksPlayed{ 0 };
+    std::atomic<std::uint64_t> m_blocksConsumed{ 0 };
+    std::atomic<std::uint64_t> m_underruns{ 0 };
+    std::atomic<std::uint64_t> m_totalLatencyNs{ 0 };
+    std::atomic<std::int64_t> m_maxLatencyNs{ 0 };
+
+    // declared last so the threads are joined before the state they use is destroyed
+    std::jthread m_renderer;
+    std::jthread m_player;
+
+    template<typename SOURCE>
+    void render_loop(std::stop_token const &stop, SOURCE &source, std::uint64_t blocks)
+    {
+      for (std::uint64_t rendered{ 0 }; rendered < blocks and !stop.stop_requested();) {
+        auto *next = m_ring.begin_push();
+        if (next == nullptr) {
+          std::this_thread::sleep_for(BlockPeriod / 4);  // full, the audio thread frees a slot each period
+          continue;
+        }
+
+        next->renderStart = Clock::now();
+        detail::render_block<BLOCK_SIZE>(source, std::span<float, Block>{ next->samples });
+        auto const renderNs = (Clock::now() - next->renderStart).count();
+        m_ring.publish();
+        ++rendered;
+
+        m_blocksRendered.store(rendered, std::memory_order_relaxed);
+        m_totalRenderNs.fetch_add(static_cast<std::uint64_t>(renderNs), std::memory_order_relaxed);
+        if (renderNs > m_maxRenderNs.load(std::memory_order_relaxed)) {
+          m_maxRenderNs.store(renderNs, std::memory_order_relaxed);
+        }
+      }
+      m_renderDone.store(true, std::memory_order_release);
+    }
+
+    void play_loop(std::stop_token const &stop)
+    {
+      // start the clock with a full ring
+      while (!stop.stop_requested() and m_ring.size() < RING_BLOCKS
+             and !m_renderDone.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(BlockPeriod / 4);
+      }
+
+      auto deadline = Clock::now();
+      while (!stop.stop_requested()) {
+        auto *current = m_ring.front();
+        if (current == nullptr and m_renderDone.load(std::memory_order_acquire)) {
+          current = m_ring.front();  // the last block may have been published just before the flag
+          if (current == nullptr) {
+            break;
+          }
+        }
+
+        if (current != nullptr) {
+          auto const latencyNs = (Clock::now() - current->renderStart).count();
+          detail::encode_pcm16(current->samples, m_pcm);
+          m_ring.pop();
+
+          m_blocksConsumed.fetch_add(1, std::memory_order_relaxed);
+          m_totalLatencyNs.fetch_add(static_cast<std::uint64_t>(latencyNs), std::memory_order_relaxed);
+          if (latencyNs > m_maxLatencyNs.load(std::memory_order_relaxed)) {
+            m_maxLatencyNs.store(latencyNs, std::memory_order_relaxed);
+          }
+        } else {
+          std::ranges::fill(m_pcm, std::byte{ 0 });
+          m_underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // after an error keep the clock running so the render thread is not stalled, stop() reports it
+        if (!m_error) {
+          try {
+            m_sink(std::span<std::byte const>{ m_pcm });
+          } catch (...) {
+            m_error = std::current_exception();
+          }
+        }
+        m_blocksPlayed.fetch_add(1, std::memory_order_relaxed);
+
+        deadline += BlockPeriod;
+        std::this_thread::sleep_until(deadline);
+      }
+
+      m_playDone.store(true);
+      m_playDone.notify_all();
+    }
+  };
+
+}  // namespace tmp
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace tmp {
+
+  // where time is spent in a block, the sequencer's time includes its instrument's
+  enum class render_stage : std::uint8_t { Sequencer, Synth, Encode };
+
+  struct block_stats
+  {
+    constexpr static std::size_t Stages = 3;
+
+    std::uint64_t firstSample{ 0 };
+    std::uint32_t samples{ 0 };
+    std::uint32_t voices{ 0 };  // playing at the end of the block
+    std::uint32_t peakVoices{ 0 };  // the most playing at once during the block
+    std::uint32_t events{ 0 };  // note events the sequencer sent to its instrument
+    std::uint32_t culled{ 0 };  // voices that finished and were removed
+    std::uint32_t clipped{ 0 };  // samples outside +/-1.0 clamped by the PCM encoder
+    std::array<std::uint64_t, Stages> nanoseconds{};  // by render_stage, 0 during constant evaluation
+  };
+
+  //
+  // The default statistics policy of synth_base and sequencer, which collects nothing. Components hold a
+  // detail::stats_hook for their policy, for this one it is empty and every hook is an empty function, so
+  // there is no storage, no branch and no clock read.
+  //
+  struct no_render_stats
+  {
+    constexpr static bool Enabled = false;
+  };
+
+  //
+  // Statistics policy that collects counters for every block, and at run time how long each render_stage
+  // took. It works during constant evaluation too (without timing), so a test can check a render:
+  //
+  //   traced_synth<sources::sin_oscillator>::type<Rate> synth{ env, vol };
+  //   sequencer sequencer{ synth };
+  //   render_stats stats;
+  //   wav.render(sequencer, stats);
+  //   static_assert(stats.peak_voices() <= 8);  // when all of this is in a constexpr function
+  //
+  // Any number of components may report to one collector, voices are counted as they start and stop
+  // so the count is over all of them. Rows are added by end_block(), which wav_renderer::render(source,
+  // stats) calls after each block; other drivers call it themselves. Call reserve() first to keep the
+  // row storage from allocating while rendering. A sequencer replaying a repeated section from its take
+  // does not play those notes on its instrument, so those blocks report no events, voices or culls.
+  //
+  class render_stats
+  {
+  public:
+    constexpr static bool Enabled = true;
+
+    constexpr void reserve(std::size_t blocks)
+    {
+      m_blocks.reserve(blocks);
+    }
+
+    constexpr void voices_started(std::uint32_t count = 1)
+    {
+      m_voices += count;
+      m_current.peakVoices = std::max(m_current.peakVoices, m_voices);
+    }
+
+    constexpr void voices_culled(std::uint32_t count)
+    {
+      m_voices -= std::min(count, m_voices);
+      m_current.culled += count;
+    }
+
+    constexpr void events_dispatched(std::uint32_t count = 1)
+    {
+      m_current.events += count;
+    }
+
+    constexpr void samples_clipped(std::uint32_t count)
+    {
+      m_current.clipped += count;
+    }
+
+    constexpr void stage_time(render_stage stage, std::chrono::nanoseconds time)
+    {
+      m_current.nanoseconds[static_cast<std::size_t>(stage)] += static_cast<std::uint64_t>(time.count());
+    }
+
+    // close the current row and start the next
+    constexpr void end_block(std::uint32_t samples)
+    {
+      m_current.samples = samples;
+      m_current.voices = m_voices;
+      m_current.peakVoices = std::max(m_current.peakVoices, m_voices);
+      m_peakVoices = std::max(m_peakVoices, m_current.peakVoices);
+      m_blocks.push_back(m_current);
+
+      m_current = block_stats{};
+      m_current.firstSample = m_blocks.back().firstSample + samples;
+      m_current.peakVoices = m_voices;
+    }
+
+    [[nodiscard]] constexpr auto blocks() const -> std::span<block_stats const>
+    {
+      return m_blocks;
+    }
+
+    [[nodiscard]] constexpr auto peak_voices() const -> std::uint32_t
+    {
+      return m_peakVoices;
+    }
+
+    // the sum of one counter over every block, e.g. total(&block_stats::clipped)
+    [[nodiscard]] constexpr auto total(std::uint32_t block_stats::*counter) const -> std::uint64_t
+    {
+      std::uint64_t sum{ 0 };
+      for (auto const &block : m_blocks) {
+        sum += block.*counter;
+      }
+      return sum;
+    }
+
+  private:
+    std::vector<block_stats> m_blocks{};
+    block_stats m_current{};
+    std::uint32_t m_voices{ 0 };
+    std::uint32_t m_peakVoices{ 0 };
+  };
+
+  namespace detail {
+    // Times a render_stage until it goes out of scope, at run time only
+    template<typename STATS>
+    class stage_timer
+    {
+    public:
+      constexpr stage_timer(STATS *stats, render_stage stage)
+        : m_stats{ stats }
+        , m_stage{ stage }
+      {
+        if !consteval {
+          if (m_stats != nullptr) {
+            m_start = std::chrono::steady_clock::now();
+          }
+        }
+      }
+
+      stage_timer(stage_timer const &) = delete;
+      auto operator=(stage_timer const &) -> stage_timer & = delete;
+
+      constexpr ~stage_timer()
+      {
+        if !consteval {
+          if (m_stats != nullptr) {
+            m_stats->stage_time(m_stage, std::chrono::steady_clock::now() - m_start);
+          }
+        }
+      }
+
+    private:
+      STATS *m_stats;
+      render_stage m_stage;
+      std::chrono::steady_clock::time_point m_start{};
+    };
+
+    //
+    // What a component keeps for its STATS policy: the collector it was attached to, if any, with a
+    // forwarding function for each hook. For no_render_stats it is an empty class of empty functions.
+    //
+    template<typename STATS>
+    class stats_hook
+    {
+    public:
+      constexpr stats_hook() = default;
+
+      constexpr explicit stats_hook(STATS *stats)
+        : m_stats{ stats }
+      {}
+
+      constexpr void attach(STATS &stats)
+      {
+        m_stats = &stats;
+      }
+
+      constexpr void voices_started(std::uint32_t count = 1) const
+      {
+        if (m_stats != nullptr) {
+          m_stats->voices_started(count);
+        }
+      }
+
+      constexpr void voices_culled(std::uint32_t count) const
+      {
+        if (m_stats != nullptr and count > 0) {
+          m_stats->voices_culled(count);
+        }
+      }
+
+      constexpr void events_dispatched(std::uint32_t count = 1) const
+      {
+        if (m_stats != nullptr) {
+          m_stats->events_dispatched(count);
+        }
+      }
+
+      constexpr void samples_clipped(std::uint32_t count) const
+      {
+        if (m_stats != nullptr and count > 0) {
+          m_stats->samples_clipped(count);
+        }
+      }
+
+      [[nodiscard]] constexpr auto time(render_stage stage) const -> stage_timer<STATS>
+      {
+        return stage_timer<STATS>{ m_stats, stage };
+      }
+
+      constexpr void end_block(std::uint32_t samples) const
+      {
+        if (m_stats != nullptr) {
+          m_stats->end_block(samples);
+        }
+      }
+
+    private:
+      STATS *m_stats{ nullptr };
+    };
+
+    template<>
+    class stats_hook<no_render_stats>
+    {
+    public:
+      struct no_timer
+      {
+      };
+
+      constexpr stats_hook() = default;
+      constexpr explicit stats_hook(no_render_stats * /*stats*/) {}
+
+      constexpr void attach(no_render_stats & /*stats*/) {}
+      constexpr void voices_started(std::uint32_t /*count*/ = 1) const {}
+      constexpr void voices_culled(std::uint32_t /*count*/) const {}
+      constexpr void events_dispatched(std::uint32_t /*count*/ = 1) const {}
+      constexpr void samples_clipped(std::uint32_t /*count*/) const {}
+      constexpr void end_block(std::uint32_t /*samples*/) const {}
+
+      [[nodiscard]] constexpr auto time(render_stage /*stage*/) const -> no_timer
+      {
+        return no_timer{};
+      }
+    };
+
+    // the STATS policy of an instrument, no_render_stats for instruments without one
+    template<typename INSTRUMENT>
+    struct stats_policy
+    {
+      using type = no_render_stats;
+    };
+
+    template<typename INSTRUMENT>
+      requires requires { typename INSTRUMENT::stats_type; }
+    struct stats_policy<INSTRUMENT>
+    {
+      using type = typename INSTRUMENT::stats_type;
+    };
+
+    // samples the PCM16 encoder will clamp
+    constexpr auto count_clipped(std::span<float const> samples) -> std::uint32_t
+    {
+      std::uint32_t clipped{ 0 };
+      for (float sample : samples) {
+        if (sample > 1.0F or sample < -1.0F) {
+          ++clipped;
+        }
+      }
+      return clipped;
+    }
+  }  // namespace detail
+
+}  // namespace tmp
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+#include "render_stats.hpp"
+
+namespace tmp {
+
+  // Exporters for render_stats, kept out of render_stats.hpp so songs rendered at compile time do not
+  // pull in the streams.
+
+  // one line per block after a header line
+  inline void write_csv(render_stats const &stats, std::ostream &out)
+  {
+    out << "first_sample,samples,voices,peak_voices,events,culled,clipped,sequencer_ns,synth_ns,encode_ns\n";
+    for (auto const &b : stats.blocks()) {
+      out << b.firstSample << ',' << b.samples << ',' << b.voices << ',' << b.peakVoices << ',' << b.events << ','
+          << b.culled << ',' << b.clipped << ',' << b.nanoseconds[0] << ',' << b.nanoseconds[1] << ','
+          << b.nanoseconds[2] << '\n';
+    }
+  }
+
+  // {"peak_voices": n, "blocks": [{...}, ...]} with the same names as the CSV columns
+  inline void write_json(render_stats const &stats, std::ostream &out)
+  {
+    out << "{\"peak_voices\": " << stats.peak_voices() << ", \"blocks\": [";
+    auto const blocks = stats.blocks();
+    for (std::size_t i{ 0 }; i < blocks.size(); ++i) {
+      auto const &b = blocks[i];
+      out << (i == 0 ? "\n" : ",\n") << "  {\"first_sample\": " << b.firstSample << ", \"samples\": " << b.samples
+          << ", \"voices\": " << b.voices << ", \"peak_voices\": " << b.peakVoices << ", \"events\": " << b.events
+          << ", \"culled\": " << b.culled << ", \"clipped\": " << b.clipped
+          << ", \"sequencer_ns\": " << b.nanoseconds[0] << ", \"synth_ns\": " << b.nanoseconds[1]
+          << ", \"encode_ns\": " << b.nanoseconds[2] << "}";
+    }
+    out << "\n]}\n";
+  }
+
+}  // namespace tmp
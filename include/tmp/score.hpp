@@ -0,0 +1,369 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "sequencer.hpp"
+#include "synth.hpp"
+#include "types.hpp"
+#include "wav_render.hpp"
+
+namespace tmp {
+
+  // the synths a score can name, the player rebuilds the instrument from this
+  enum class score_instrument : std::uint8_t { Sin, Wavetable, Saw, Square, Triangle };
+
+  namespace detail {
+    template<score_instrument INSTRUMENT>
+    struct score_synth;
+
+    template<>
+    struct score_synth<score_instrument::Sin>
+    {
+      template<sample_rate RATE>
+      using type = instruments::sin_synth<RATE>;
+    };
+
+    template<>
+    struct score_synth<score_instrument::Wavetable>
+    {
+      template<sample_rate RATE>
+      using type = instruments::wavetable_synth<RATE>;
+    };
+
+    template<>
+    struct score_synth<score_instrument::Saw>
+    {
+      template<sample_rate RATE>
+      using type = instruments::saw_synth<RATE>;
+    };
+
+    template<>
+    struct score_synth<score_instrument::Square>
+    {
+      template<sample_rate RATE>
+      using type = instruments::square_synth<RATE>;
+    };
+
+    template<>
+    struct score_synth<score_instrument::Triangle>
+    {
+      template<sample_rate RATE>
+      using type = instruments::triangle_synth<RATE>;
+    };
+
+    //
+    // A score is a song kept as the events and instrument settings that produce it instead of its samples.
+    // It starts with a 44 byte header:
+    //
+    //   "TMPC"  u32 sample rate  u32 frames  u8 instrument  u8 u16 reserved (0)
+    //   f32 attack time  f32 attack level  f32 decay time  f32 decay level  f32 release time  f32 volume
+    //   u32 events
+    //
+    // followed by the events sorted by note on, 9 bytes each: u8 note number  u32 note on  u32 length.
+    // Times are in seconds and levels linear, all little endian except the id.
+    //
+    struct score_header
+    {
+      constexpr static std::uint32_t Size = 44;
+      constexpr static std::uint32_t EventSize = 9;
+      constexpr static std::uint32_t Id = 0x544d5043;  // "TMPC", big endian
+
+      std::uint32_t sampleRate;
+      std::uint32_t frames;
+      score_instrument instrument;
+      envelope env;
+      volume vol;
+      std::uint32_t events;
+
+      constexpr void render(std::span<std::byte, Size> buffer) const
+      {
+        detail::write_be(buffer.subspan<0, 4>(), Id);
+        detail::write_le(buffer.subspan<4, 4>(), sampleRate);
+        detail::write_le(buffer.subspan<8, 4>(), frames);
+        buffer[12] = static_cast<std::byte>(instrument);
+        buffer[13] = std::byte{ 0 };
+        detail::write_le(buffer.subspan<14, 2>(), std::uint16_t{ 0 });
+        detail::write_le(buffer.subspan<16, 4>(), std::bit_cast<std::uint32_t>(env.attackTime.period));
+        detail::write_le(buffer.subspan<20, 4>(), std::bit_cast<std::uint32_t>(env.attackLevel.value));
+        detail::write_le(buffer.subspan<24, 4>(), std::bit_cast<std::uint32_t>(env.decayTime.period));
+        detail::write_le(buffer.subspan<28, 4>(), std::bit_cast<std::uint32_t>(env.decayLevel.value));
+        detail::write_le(buffer.subspan<32, 4>(), std::bit_cast<std::uint32_t>(env.releaseTime.period));
+        detail::write_le(buffer.subspan<36, 4>(), std::bit_cast<std::uint32_t>(vol.value));
+        detail::write_le(buffer.subspan<40, 4>(), events);
+      }
+
+      static constexpr auto parse(std::span<std::byte const> buffer) -> score_header
+      {
+        if (buffer.size() < Size or read_le32(buffer.subspan(0, 4)) != std::byteswap(Id)) {
+          throw std::invalid_argument{ "not a score, missing TMPC header" };
+        }
+        if (std::to_integer<std::uint8_t>(buffer[12]) > std::to_underlying(score_instrument::Triangle)) {
+          throw std::invalid_argument{ "score names an unknown instrument" };
+        }
+
+        auto read_float = [&](std::size_t offset) { return std::bit_cast<float>(read_le32(buffer.subspan(offset, 4))); };
+        score_header header{ read_le32(buffer.subspan(4, 4)),
+          read_le32(buffer.subspan(8, 4)),
+          static_cast<score_instrument>(buffer[12]),
+          envelope{ seconds{ read_float(16) },
+            volume{ read_float(20) },
+            seconds{ read_float(24) },
+            volume{ read_float(28) },
+            seconds{ read_float(32) } },
+          volume{ read_float(36) },
+          read_le32(buffer.subspan(40, 4)) };
+        if (buffer.size() < Size + (std::size_t{ header.events } * EventSize)) {
+          throw std::invalid_argument{ "score is shorter than its header says" };
+        }
+        return header;
+      }
+
+      static constexpr void render_event(std::span<std::byte, EventSize> buffer, compact_event event)
+      {
+        buffer[0] = static_cast<std::byte>(event.noteNumber);
+        detail::write_le(buffer.subspan<1, 4>(), event.noteOn);
+        detail::write_le(buffer.subspan<5, 4>(), event.length);
+      }
+
+      // the events of a score already checked by parse()
+      static constexpr auto parse_events(std::span<std::byte const> buffer, score_header const &header)
+        -> std::vector<compact_event>
+      {
+        std::vector<compact_event> events;
+        events.reserve(header.events);
+        for (std::size_t i{ 0 }; i < header.events; ++i) {
+          auto event = buffer.subspan(Size + (i * EventSize), EventSize);
+          events.push_back(compact_event{
+            std::to_integer<std::uint8_t>(event[0]), read_le32(event.subspan(1, 4)), read_le32(event.subspan(5, 4)) });
+        }
+        return events;
+      }
+
+      static constexpr auto read_le32(std::span<std::byte const> buffer) -> std::uint32_t
+      {
+        return std::to_integer<std::uint32_t>(buffer[0]) | (std::to_integer<std::uint32_t>(buffer[1]) << 8U)
+               | (std::to_integer<std::uint32_t>(buffer[2]) << 16U)
+               | (std::to_integer<std::uint32_t>(buffer[3]) << 24U);
+      }
+    };
+  }  // namespace detail
+
+
+  //
+  // Writes a song's score at compile time instead of its samples, see add_wav(name SCORE ...) in
+  // CMakeLists.txt. The events come from bake_music(), the frame count is what wav_renderer would render
+  // for the same length and block size so a score plays back to the same file.
+  //
+  //   static constexpr auto Events = bake_music<Rate>(musicSource);
+  //   score_writer<Rate, music_length, Events.size()> score{};
+  //   score.write(score_instrument::Sin, envelope{ ... }, -1.0_dBfs, Events);
+  //
+  template<sample_rate RATE, seconds SECONDS, std::size_t EVENTS, block_size BLOCK_SIZE = block_size{ 128 }>
+  struct score_writer
+  {
+    using Header = detail::score_header;
+
+    static constexpr std::uint32_t NumFrames = detail::wav_fmt_chunk<RATE>::number_frames(SECONDS, BLOCK_SIZE);
+    static constexpr std::size_t TotalSize = Header::Size + (EVENTS * Header::EventSize);
+
+    std::array<std::byte, TotalSize> data;
+
+    constexpr void write(score_instrument instrument, envelope env, volume vol, std::span<compact_event const> events)
+    {
+      if (events.size() != EVENTS) {
+        throw std::invalid_argument{ "score_writer sized for a different number of events" };
+      }
+
+      std::span<std::byte, TotalSize> buffer{ data };
+      Header{ RATE.samples_per_second, NumFrames, instrument, env, vol, static_cast<std::uint32_t>(EVENTS) }.render(
+        buffer.template first<Header::Size>());
+      for (std::size_t i{ 0 }; i < EVENTS; ++i) {
+        Header::render_event(
+          buffer.subspan(Header::Size + (i * Header::EventSize)).template first<Header::EventSize>(), events[i]);
+      }
+    }
+  };
+
+
+  //
+  // Plays a score with the same sequencer and synth code a pre-rendered song uses, a block at a time.
+  // The score is parsed once in the constructor, after that render() only allocates what the synth does
+  // for each note. Renders as many samples as asked for, frames() is where the song ends.
+  //
+  //   score_player<Rate, score_instrument::Sin> player{ score };
+  //   realtime_engine<Rate, fd_sink> engine{ fd_sink{ fd } };
+  //   engine.start(player);
+  //
+  template<sample_rate RATE, score_instrument INSTRUMENT>
+  class score_player
+  {
+  public:
+    static constexpr sample_rate Rate = RATE;
+    static constexpr score_instrument Instrument = INSTRUMENT;
+
+    template<sample_rate R>
+    using synth_type = typename detail::score_synth<INSTRUMENT>::template type<R>;
+
+    // throws std::invalid_argument unless the score was written for RATE and INSTRUMENT
+    constexpr explicit score_player(std::span<std::byte const> score)
+      : m_header{ checked(score) }
+      , m_events{ detail::score_header::parse_events(score, m_header) }
+      , m_synth{ m_header.env, m_header.vol }
+      , m_sequencer{ m_synth }
+    {
+      m_sequencer.play_events(m_events);
+    }
+
+    score_player(score_player const &) = delete;
+    auto operator=(score_player const &) -> score_player & = delete;
+
+    template<block_size BLOCK_SIZE>
+    constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+    {
+      return render(std::span<float>{ buffer });
+    }
+
+    constexpr auto render(std::span<float> buffer) -> block_state
+    {
+      return m_sequencer.render(buffer);
+    }
+
+    [[nodiscard]] constexpr auto frames() const -> std::uint32_t
+    {
+      return m_header.frames;
+    }
+
+    [[nodiscard]] constexpr auto events() const -> std::span<compact_event const>
+    {
+      return m_events;
+    }
+
+  private:
+    detail::score_header m_header;
+    std::vector<compact_event> m_events;
+    synth_type<RATE> m_synth;
+    sequencer<RATE, synth_type> m_sequencer;
+
+    static constexpr auto checked(std::span<std::byte const> score) -> detail::score_header
+    {
+      auto header = detail::score_header::parse(score);
+      if (header.sampleRate != RATE.samples_per_second) {
+        throw std::invalid_argument{ "score was written for a different sample rate" };
+      }
+      if (header.instrument != INSTRUMENT) {
+        throw std::invalid_argument{ "score was written for a different instrument" };
+      }
+      return header;
+    }
+  };
+
+
+  //
+  // A score rendered on demand into a buffer that holds the whole song, for random access playback.
+  // Nothing is synthesised until samples() asks for it, then only up to the end of the block holding the
+  // last sample asked for, so the cost of rendering is spread over playback instead of paid at load time.
+  //
+  template<sample_rate RATE, score_instrument INSTRUMENT, block_size BLOCK_SIZE = block_size{ 128 }>
+  class score_buffer
+  {
+  public:
+    constexpr explicit score_buffer(std::span<std::byte const> score)
+      : m_player{ score }
+      , m_samples(((std::size_t{ m_player.frames() } + BLOCK_SIZE.samplesPerBlock - 1) / BLOCK_SIZE.samplesPerBlock)
+                  * BLOCK_SIZE.samplesPerBlock)
+    {}
+
+    // samples [first, first + count) clipped to the end of the song, rendering any not rendered yet
+    constexpr auto samples(std::size_t first, std::size_t count) -> std::span<float const>
+    {
+      first = std::min<std::size_t>(first, m_player.frames());
+      count = std::min<std::size_t>(count, m_player.frames() - first);
+      while (m_rendered < first + count) {
+        m_player.template render<BLOCK_SIZE>(
+          std::span<float>{ m_samples }.subspan(m_rendered).template first<BLOCK_SIZE.samplesPerBlock>());
+        m_rendered += BLOCK_SIZE.samplesPerBlock;
+      }
+      return std::span<float const>{ m_samples }.subspan(first, count);
+    }
+
+    [[nodiscard]] constexpr auto frames() const -> std::uint32_t
+    {
+      return m_player.frames();
+    }
+
+    // samples rendered so far, always whole blocks
+    [[nodiscard]] constexpr auto rendered() const -> std::size_t
+    {
+      return m_rendered;
+    }
+
+  private:
+    score_player<RATE, INSTRUMENT> m_player;
+    std::vector<float> m_samples;
+    std::size_t m_rendered{ 0 };
+  };
+
+
+  namespace detail {
+    template<sample_rate RATE, score_instrument INSTRUMENT, typename VISITOR>
+    constexpr void visit_score_player(std::span<std::byte const> score, VISITOR &visitor)
+    {
+      score_player<RATE, INSTRUMENT> player{ score };
+      visitor(player);
+    }
+
+    template<sample_rate RATE, typename VISITOR>
+    constexpr auto visit_score_rate(std::span<std::byte const> score, score_header const &header, VISITOR &visitor)
+      -> bool
+    {
+      if (header.sampleRate != RATE.samples_per_second) {
+        return false;
+      }
+      switch (header.instrument) {
+      case score_instrument::Sin:
+        visit_score_player<RATE, score_instrument::Sin>(score, visitor);
+        break;
+      case score_instrument::Wavetable:
+        visit_score_player<RATE, score_instrument::Wavetable>(score, visitor);
+        break;
+      case score_instrument::Saw:
+        visit_score_player<RATE, score_instrument::Saw>(score, visitor);
+        break;
+      case score_instrument::Square:
+        visit_score_player<RATE, score_instrument::Square>(score, visitor);
+        break;
+      case score_instrument::Triangle:
+        visit_score_player<RATE, score_instrument::Triangle>(score, visitor);
+        break;
+      }
+      return true;
+    }
+  }  // namespace detail
+
+  //
+  // Calls visitor(player) with a score_player for the rate and instrument the score was written with, for
+  // tools that only learn them at run time. A player is instantiated for every instrument at each rate
+  // in detail::CommonRates, other rates throw std::invalid_argument. A program that knows its song should
+  // use score_player directly and only pay for one.
+  //
+  template<typename VISITOR>
+  constexpr void visit_score(std::span<std::byte const> score, VISITOR &&visitor)
+  {
+    auto const header = detail::score_header::parse(score);
+    bool const visited = [&]<std::size_t... R>(std::index_sequence<R...>) {
+      return (detail::visit_score_rate<sample_rate{ detail::CommonRates[R] }>(score, header, visitor) or ...);
+    }(std::make_index_sequence<detail::CommonRates.size()>{});
+    if (not visited) {
+      throw std::invalid_argument{ "score sample rate is not one of detail::CommonRates" };
+    }
+  }
+
+}  // namespace tmp
@@ -1,18 +1,40 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <optional>
+#include <ranges>
 #include <span>
 #include <stdexcept>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
+#include "render_stats.hpp"
 #include "types.hpp"
 
 namespace tmp {
 
+  class event_inbox;  // event_inbox.hpp, for attach_inbox()
+
   namespace detail {
+    //
+    // A score is one or more patterns of note lines. Without any `[name]` lines the whole score is a
+    // single pattern played once. Otherwise each `[name]` line starts a pattern and `>` lines give the
+    // order to play them in, a name followed by `*N` is repeated N times:
+    //
+    //   [intro]
+    //   C4 |#   :    :    :    |
+    //   [verse]
+    //   C4 |# # :##  :    :    |
+    //   > intro verse*3 intro
+    //
+    // Without a `>` line the patterns play once each in the order they are written.
+    //
     class parser
     {
     public:
@@ -21,14 +43,16 @@ namespace tmp {
         , m_beat{ 60.0F / static_cast<float>(m_bpm.rate) }
         , m_bar{ m_beat.period * 4.0F }
         , m_16th{ m_bar.period / 16.0F }
-        , m_noteLines{ extract_note_lines(music) }
-      {}
+      {
+        extract_patterns(music);
+      }
 
       constexpr auto length() -> seconds
       {
-        // cut the "C4 |"
-        auto notes = m_noteLines[0].substr(4);
-        auto sixteenths = std::count_if(notes.begin(), notes.end(), [](auto c) { return c == ' ' or c == '#'; });
+        std::size_t sixteenths{ 0 };
+        for (auto p : m_arrangement) {
+          sixteenths += m_patterns[p].sixteenths;
+        }
         return seconds{ m_16th.period * static_cast<float>(sixteenths) };
       }
 
@@ -36,25 +60,53 @@ namespace tmp {
       {
         using namespace tmp::literals;
 
-        for (auto l : m_noteLines) {
-          auto noteName = l[2] == ' ' ? l.substr(0, 2) : l.substr(0, 3);
-          auto notes = l.substr(4);
-          parse_note_events(noteName, notes, insert);
+        std::size_t start16th{ 0 };
+        for (auto p : m_arrangement) {
+          for (auto l : m_patterns[p].noteLines) {
+            auto noteName = l[2] == ' ' ? l.substr(0, 2) : l.substr(0, 3);
+            auto notes = l.substr(4);
+            parse_note_events(noteName, notes, start16th, insert);
+          }
+          start16th += m_patterns[p].sixteenths;
+        }
+      }
+
+      // Each stretch of the arrangement as insert(pattern index, seconds start, seconds end), in order
+      constexpr void parse_sections(auto insert)
+      {
+        std::size_t start16th{ 0 };
+        for (auto p : m_arrangement) {
+          auto end16th = start16th + m_patterns[p].sixteenths;
+          insert(p,
+            seconds{ static_cast<float>(start16th) * m_16th.period },
+            seconds{ static_cast<float>(end16th) * m_16th.period });
+          start16th = end16th;
         }
       }
 
     private:
+      struct pattern
+      {
+        std::string_view name;
+        std::vector<std::string_view> noteLines;
+        std::size_t sixteenths;
+      };
+
       beats_per_minute m_bpm;
       seconds m_beat;
       seconds m_bar;
       seconds m_16th;
-      std::vector<std::string_view> m_noteLines;
+      std::vector<pattern> m_patterns;
+      std::vector<std::size_t> m_arrangement;  // pattern indices in play order
 
-      constexpr void parse_note_events(std::string_view noteName, std::string_view line, auto insert)
+      constexpr void parse_note_events(std::string_view noteName,
+        std::string_view line,
+        std::size_t first16th,
+        auto insert)
       {
         bool foundNoteStart{ false };
         std::size_t start16th{ 0 };
-        std::size_t current16th{ 0 };
+        std::size_t current16th{ first16th };
         for (auto c : line) {
           if (c == '|' or c == ':') continue;
 
@@ -78,9 +130,88 @@ namespace tmp {
         }
       }
 
-      static constexpr auto extract_note_lines(std::string_view music) -> std::vector<std::string_view>
+      constexpr void extract_patterns(std::string_view music)
       {
-        std::vector<std::string_view> noteLines{};
+        std::vector<std::string_view> arrangementLines{};
+        for (auto l : split_lines(music)) {
+          if (l.starts_with('[')) {
+            if (!l.ends_with(']') or l.size() < 3) {
+              throw std::invalid_argument{ "pattern line must be a name in square brackets, [name]" };
+            }
+            m_patterns.push_back(pattern{ l.substr(1, l.size() - 2), {}, 0 });
+          } else if (l.starts_with('>')) {
+            arrangementLines.push_back(l.substr(1));
+          } else {
+            if (m_patterns.empty()) {
+              m_patterns.push_back(pattern{ {}, {}, 0 });  // a score without patterns
+            }
+            m_patterns.back().noteLines.push_back(l);
+          }
+        }
+
+        if (m_patterns.empty()) {
+          throw std::invalid_argument{ "no music lines found" };
+        }
+        if (m_patterns.size() > 1 and m_patterns.front().name.empty()) {
+          throw std::invalid_argument{ "music lines before the first [pattern]" };
+        }
+        for (auto &p : m_patterns) {
+          validate_note_lines(p.noteLines);
+          auto notes = p.noteLines[0].substr(4);
+          p.sixteenths = static_cast<std::size_t>(
+            std::count_if(notes.begin(), notes.end(), [](auto c) { return c == ' ' or c == '#'; }));
+        }
+
+        for (auto l : arrangementLines) {
+          parse_arrangement(l);
+        }
+        if (arrangementLines.empty()) {
+          for (std::size_t p{ 0 }; p < m_patterns.size(); ++p) {
+            m_arrangement.push_back(p);
+          }
+        }
+      }
+
+      // "name name*2 ..." onto the end of the arrangement
+      constexpr void parse_arrangement(std::string_view line)
+      {
+        constexpr auto END = std::string_view::npos;
+        std::size_t pos{ 0 };
+        while ((pos = line.find_first_not_of(' ', pos)) != END) {
+          auto end = line.find(' ', pos);
+          auto entry = line.substr(pos, end == END ? END : end - pos);
+          pos = end;
+
+          std::size_t repeats{ 1 };
+          if (auto star = entry.find('*'); star != END) {
+            repeats = 0;
+            for (auto c : entry.substr(star + 1)) {
+              if (c < '0' or c > '9') {
+                throw std::invalid_argument{ "pattern repeat count must be a number, name*N" };
+              }
+              repeats = (repeats * 10) + static_cast<std::size_t>(c - '0');
+            }
+            if (repeats == 0) {
+              throw std::invalid_argument{ "pattern repeat count must be at least 1, name*N" };
+            }
+            entry = entry.substr(0, star);
+          }
+
+          auto found = std::ranges::find(m_patterns, entry, &pattern::name);
+          if (found == m_patterns.end()) {
+            throw std::invalid_argument{ "arrangement names a pattern that is not defined" };
+          }
+          auto index = static_cast<std::size_t>(found - m_patterns.begin());
+          for (std::size_t r{ 0 }; r < repeats; ++r) {
+            m_arrangement.push_back(index);
+          }
+        }
+      }
+
+      // non empty lines that do not begin with a space
+      static constexpr auto split_lines(std::string_view music) -> std::vector<std::string_view>
+      {
+        std::vector<std::string_view> lines{};
 
         constexpr auto END = std::string_view::npos;
         std::size_t pos{ 0 };
@@ -96,14 +227,18 @@ namespace tmp {
           if (i > 0 and music[i - 1] == '\r') {
             len -= 1;
           }
-          noteLines.push_back(music.substr(pos, len));
+          lines.push_back(music.substr(pos, len));
           // move beyond the \n
           pos = i + 1;
         } while (pos < music.length());
 
         // filter empty lines and lines that start with spaces
-        std::erase_if(noteLines, [](auto sv) { return sv.empty() or sv[0] == ' '; });
+        std::erase_if(lines, [](auto sv) { return sv.empty() or sv[0] == ' '; });
+        return lines;
+      }
 
+      static constexpr void validate_note_lines(std::vector<std::string_view> const &noteLines)
+      {
         // validate that all lines have a '|' at position 3 and last position and are same length
         if (noteLines.empty()) {
           throw std::invalid_argument{ "no music lines found" };
@@ -125,8 +260,6 @@ namespace tmp {
             throw std::invalid_argument{ "music line must end with '|'" };
           }
         }
-
-        return noteLines;
       }
     };
   }  // namespace detail
@@ -138,7 +271,47 @@ namespace tmp {
     return p.length();
   }
 
-  template<sample_rate RATE, template<sample_rate> typename INSTRUMENT>
+  constexpr auto count_music_events(auto getMusic) -> std::size_t
+  {
+    auto music = getMusic();
+    detail::parser p{ music.bpm, music.source };
+    std::size_t count{ 0 };
+    p.parse_events([&count](note, seconds, seconds) { ++count; });
+    return count;
+  }
+
+  //
+  // Parse music into a table of compact events at compile time, sized exactly by a counting pass and
+  // sorted by note on, so a sequencer can play it with play_events() without allocating or sorting.
+  // GET_MUSIC must be default constructible, as a lambda without captures is.
+  //
+  //   static constexpr auto Events = bake_music<Rate>(musicSource);
+  //   sequencer.play_events(Events);
+  //
+  template<sample_rate RATE, typename GET_MUSIC>
+  constexpr auto bake_music(GET_MUSIC getMusic) -> std::array<compact_event, count_music_events(GET_MUSIC{})>
+  {
+    std::array<compact_event, count_music_events(GET_MUSIC{})> events{};
+
+    auto music = getMusic();
+    detail::parser p{ music.bpm, music.source };
+    std::size_t next{ 0 };
+    p.parse_events([&](note n, seconds on, seconds off) {
+      auto onSample = on.to_samples(RATE);
+      events[next++] =
+        compact_event{ static_cast<std::uint8_t>(n.note_number), onSample, off.to_samples(RATE) - onSample };
+    });
+
+    std::sort(events.begin(), events.end(), [](auto const &lhs, auto const &rhs) { return lhs.noteOn < rhs.noteOn; });
+    return events;
+  }
+
+  // STATS counts the events sent to the instrument and times render() into a render_stats given to
+  // attach_stats(), it follows the instrument's policy so a traced_synth makes a traced sequencer.
+  template<sample_rate RATE,
+    template<sample_rate>
+    typename INSTRUMENT,
+    typename STATS = typename detail::stats_policy<INSTRUMENT<RATE>>::type>
   class sequencer
   {
   public:
@@ -146,16 +319,72 @@ namespace tmp {
       : m_instrument{ instrument }
     {}
 
+    // copy the events and position of another sequencer but drive a different instrument
+    constexpr sequencer(sequencer const &other, INSTRUMENT<RATE> &instrument)
+      : m_instrument{ instrument }
+      , m_blockStartSampleNumber{ other.m_blockStartSampleNumber }
+      , m_timeline{ other.m_timeline }
+      , m_timelineCursor{ other.m_timelineCursor }
+      , m_timelineSorted{ other.m_timelineSorted }
+      , m_eventQueueContainer{ other.m_eventQueueContainer }
+      , m_baked{ other.m_baked }
+      , m_bakedCursor{ other.m_bakedCursor }
+      , m_sections{ other.m_sections }
+      , m_takes{ other.m_takes }
+      , m_section{ other.m_section }
+      , m_sectionMode{ other.m_sectionMode }
+      , m_sectionEvents{ other.m_sectionEvents }
+      , m_sectionEventCursor{ other.m_sectionEventCursor }
+      , m_reusedSamples{ other.m_reusedSamples }
+    {}
+
+    // Play a table of events from bake_music(), which must outlive the sequencer. The table is already
+    // sorted so it is walked with a cursor, nothing is copied or allocated. Replaces any previous table.
+    constexpr void play_events(std::span<compact_event const> events)
+    {
+      m_baked = events;
+      m_bakedCursor = 0;
+    }
+
     constexpr void parse_music(auto getMusic)
     {
       auto music = getMusic();
       detail::parser p{ music.bpm, music.source };
 
       p.parse_events([&](note n, seconds on, seconds off) {
-        m_eventQueueContainer.emplace_back(n, on.to_samples(RATE), off.to_samples(RATE));
+        m_timeline.emplace_back(n, on.to_samples(RATE), off.to_samples(RATE));
       });
 
-      std::make_heap(m_eventQueueContainer.begin(), m_eventQueueContainer.end(), event_min_sorter{});
+      // sorted once on the next render, so loading several parts only sorts once
+      m_timelineSorted = false;
+
+      // Sections of the first score with repeated patterns are kept for replaying. Other parts on the same
+      // sequencer are fine, a section is only replayed when all of its events match the earlier take.
+      if (m_sections.empty()) {
+        std::vector<section> sections;
+        std::vector<pattern_take> takes;
+        bool repeats{ false };
+        p.parse_sections([&](std::size_t pattern, seconds start, seconds end) {
+          sections.push_back(section{ pattern, start.to_samples(RATE), end.to_samples(RATE) });
+          takes.resize(std::max(takes.size(), pattern + 1));
+          repeats = ++takes[pattern].plays > 1 or repeats;
+        });
+        if (repeats) {
+          m_sections = std::move(sections);
+          m_takes = std::move(takes);
+        }
+      }
+    }
+
+    // Queue many events up front, each element must destructure to [note, seconds on, seconds off].
+    // Like parse_music() these go onto the sorted timeline rather than the heap.
+    template<std::ranges::input_range EVENTS>
+    constexpr void queue_events(EVENTS const &events)
+    {
+      for (auto const &[n, on, off] : events) {
+        m_timeline.emplace_back(n, on.to_samples(RATE), off.to_samples(RATE));
+      }
+      m_timelineSorted = false;
     }
 
     constexpr void queue_event(note note, seconds noteOn, seconds noteOff)
@@ -168,32 +397,130 @@ namespace tmp {
       queue_emplace(note, noteOnSample, noteOffSample);
     }
 
-    template<block_size BLOCK_SIZE>
-    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+    // Jump forward so the next render() starts at `sampleNumber` without rendering the audio before it.
+    // Notes that started earlier are handed to the instrument's resume_note(), which works out where
+    // they have got to, so release tails carry over into the new position.
+    constexpr void seek(std::uint32_t sampleNumber)
+      requires requires(INSTRUMENT<RATE> &i, note n) { i.resume_note(n, 0U, 0U); }
     {
-      // find events to trigger for this block
-      std::uint32_t blockEndSampleNumber = m_blockStartSampleNumber + BLOCK_SIZE.samplesPerBlock - 1;
-      while (!queue_is_empty()) {
+      if (!m_timelineSorted) {
+        sort_timeline();
+      }
 
-        auto &e = queue_top();
-        // is the soonest event after this current block? if so we can stop looking
-        if (e.noteOn > blockEndSampleNumber) {
+      while (auto e = next_event()) {
+        if (e->noteOn >= sampleNumber) {
           break;
         }
 
-        // this event is in the block, send it to the instrument, this expects when to start
-        // after the next render() block is called and the length to play
-        m_instrument.play_note(e.playNote, e.noteOn - m_blockStartSampleNumber, e.noteOff - e.noteOn);
-        queue_pop();
+        m_instrument.resume_note(e->playNote, sampleNumber - e->noteOn, e->noteOff - e->noteOn);
+        pop_next_event(*e);
       }
 
-      m_instrument.template render<BLOCK_SIZE>(buffer);
+      m_blockStartSampleNumber = sampleNumber;
 
-      // ready for next block
-      m_blockStartSampleNumber += BLOCK_SIZE.samplesPerBlock;
+      // the section this lands in is rendered as usual, later ones can still be recorded or replayed
+      m_section = 0;
+      m_sectionMode = section_mode::Waiting;
+      m_sectionEvents.clear();
+      m_sectionEventCursor = 0;
+    }
+
+    template<block_size BLOCK_SIZE>
+    constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+    {
+      return render_buffer<BLOCK_SIZE>(buffer);
+    }
+
+    constexpr auto render(std::span<float> buffer) -> block_state
+    {
+      return render_buffer<detail::AnyBlockSize>(buffer);
+    }
+
+    // Take events pushed live from other threads, merged in at the start of every render(). The event
+    // heap is reserved for the inbox's capacity here, so merging never allocates on the render thread.
+    // Run time only, and only one sequencer may take from an inbox. The caller includes event_inbox.hpp,
+    // the sequencer only declares it so songs rendered at compile time do not pull in the atomics.
+    template<std::same_as<event_inbox> INBOX>
+    void attach_inbox(INBOX &inbox)
+    {
+      m_eventQueueContainer.reserve(m_eventQueueContainer.size() + inbox.capacity());
+      m_inbox = &inbox;
+      m_syncInbox = &sync_inbox<INBOX>;
+      inbox.set_position(m_blockStartSampleNumber);
+    }
+
+    // Report to `stats`, and have the instrument report to it too if it has the same policy
+    constexpr void attach_stats(STATS &stats)
+    {
+      m_stats.attach(stats);
+      if constexpr (requires { m_instrument.attach_stats(stats); }) {
+        m_instrument.attach_stats(stats);
+      }
+    }
+
+    // Samples copied from an earlier take of a repeated pattern instead of being rendered
+    [[nodiscard]] constexpr auto reused_samples() const -> std::uint64_t
+    {
+      return m_reusedSamples;
     }
 
   private:
+    // BLOCK_SIZE is only passed on to instruments without a dynamic extent render()
+    template<block_size BLOCK_SIZE>
+    constexpr auto render_buffer(std::span<float> buffer) -> block_state
+    {
+      [[maybe_unused]] auto timer = m_stats.time(render_stage::Sequencer);
+      if !consteval {
+        if (m_syncInbox != nullptr) {
+          m_syncInbox(*this, inbox_step::BlockStart);
+        }
+      }
+
+      auto state = render_parts<BLOCK_SIZE>(buffer);
+
+      if !consteval {
+        if (m_syncInbox != nullptr) {
+          m_syncInbox(*this, inbox_step::BlockEnd);
+        }
+      }
+      return state;
+    }
+
+    template<block_size BLOCK_SIZE>
+    constexpr auto render_parts(std::span<float> buffer) -> block_state
+    {
+      if (!m_timelineSorted) {
+        sort_timeline();
+      }
+      if constexpr (detail::span_source<INSTRUMENT<RATE>>) {
+        if (m_sections.empty()) {
+          return render_events(buffer);
+        }
+        return render_sections(buffer);
+      } else {
+        return render_events<BLOCK_SIZE>(buffer);  // whole blocks only, sections cannot be split out
+      }
+    }
+
+    // split the block where sections begin and end, each part is then rendered or replayed
+    constexpr auto render_sections(std::span<float> buffer) -> block_state
+    {
+      auto state = block_state::Silent;
+      while (!buffer.empty()) {
+        auto part = buffer.first(next_section_part(buffer.size()));
+        auto partState = m_sectionMode == section_mode::Replay ? replay_section(part) : render_section(part);
+        if (partState == block_state::Audible) {
+          state = block_state::Audible;
+        }
+        buffer = buffer.subspan(part.size());
+
+        if (m_section < m_sections.size() and m_blockStartSampleNumber == m_sections[m_section].end) {
+          end_section();
+        }
+      }
+      return state;
+    }
+
     // note events in absolute sample number time
     struct event
     {
@@ -202,6 +529,225 @@ namespace tmp {
       std::uint32_t noteOff;
     };
 
+    // One stretch of an arranged score playing a single pattern, in absolute sample numbers
+    struct section
+    {
+      std::size_t pattern;
+      std::uint32_t start;
+      std::uint32_t end;
+    };
+
+    // The first complete rendering of a pattern that plays more than once. A take is only complete when
+    // the instrument was idle at both ends, so nothing carried in and no release tails carried out.
+    struct pattern_take
+    {
+      std::size_t plays{ 0 };  // in the arrangement
+      bool complete{ false };
+      std::vector<event> events{};  // relative to the section start, in event_order
+      std::vector<float> samples{};
+    };
+
+    enum class section_mode : std::uint8_t {
+      Waiting,  // before the current section starts
+      Live,  // rendered as usual
+      Record,  // rendered and kept as the pattern's take
+      Replay  // copied from the pattern's take
+    };
+
+    template<block_size BLOCK_SIZE = detail::AnyBlockSize>
+    constexpr auto render_events(std::span<float> buffer) -> block_state
+    {
+      auto const samples = static_cast<std::uint32_t>(buffer.size());
+
+      // find events to trigger for this block
+      std::uint32_t blockEndSampleNumber = m_blockStartSampleNumber + samples - 1;
+      while (auto e = next_event()) {
+        // is the soonest event after this current block? if so we can stop looking
+        if (e->noteOn > blockEndSampleNumber) {
+          break;
+        }
+
+        // this event is in the block, send it to the instrument, this expects when to start
+        // after the next render() block is called and the length to play
+        m_instrument.play_note(e->playNote, e->noteOn - m_blockStartSampleNumber, e->noteOff - e->noteOn);
+        m_stats.events_dispatched();
+        pop_next_event(*e);
+      }
+
+      auto state = detail::render_span<BLOCK_SIZE>(m_instrument, buffer);
+
+      // ready for next block
+      m_blockStartSampleNumber += samples;
+      return state;
+    }
+
+    // the length of the next part of a block that does not cross a section boundary, starting the
+    // section when the part is its first
+    constexpr auto next_section_part(std::size_t samples) -> std::size_t
+    {
+      // after a seek there may be sections already passed
+      while (m_section < m_sections.size() and m_blockStartSampleNumber >= m_sections[m_section].end) {
+        ++m_section;
+      }
+      if (m_section == m_sections.size()) {
+        return samples;
+      }
+
+      auto const &current = m_sections[m_section];
+      if (m_blockStartSampleNumber < current.start) {
+        return std::min<std::size_t>(samples, current.start - m_blockStartSampleNumber);
+      }
+      if (m_sectionMode == section_mode::Waiting) {
+        begin_section();
+      }
+      return std::min<std::size_t>(samples, current.end - m_blockStartSampleNumber);
+    }
+
+    constexpr void begin_section()
+    {
+      auto const &current = m_sections[m_section];
+      m_sectionMode = section_mode::Live;
+      m_sectionEvents.clear();
+      m_sectionEventCursor = 0;
+      if (m_blockStartSampleNumber != current.start) {
+        return;  // joined part way through by a seek
+      }
+
+      // take the section's events off the timeline up front so they can be compared with the earlier take
+      while (auto e = next_event()) {
+        if (e->noteOn >= current.end) {
+          break;
+        }
+        if (e->noteOn < current.start) {
+          return;  // a late event, render this section as usual
+        }
+        m_sectionEvents.push_back(event{ e->playNote, e->noteOn - current.start, e->noteOff - current.start });
+        pop_next_event(*e);
+      }
+      std::ranges::sort(m_sectionEvents, event_order{});
+
+      auto &take = m_takes[current.pattern];
+      if (!instrument_is_idle()) {
+        return;
+      }
+      if (take.complete and std::ranges::equal(take.events, m_sectionEvents, same_event)) {
+        m_sectionMode = section_mode::Replay;
+      } else if (!take.complete and take.plays > 1) {
+        take.events = m_sectionEvents;
+        take.samples.clear();
+        m_sectionMode = section_mode::Record;
+      }
+    }
+
+    constexpr void end_section()
+    {
+      if (m_sectionMode == section_mode::Record) {
+        auto &take = m_takes[m_sections[m_section].pattern];
+        if (instrument_is_idle()) {
+          take.complete = true;
+        } else {
+          // a tail carries into the next section, try again at the next play
+          take.events.clear();
+          take.samples.clear();
+        }
+      }
+
+      m_sectionEvents.clear();
+      m_sectionEventCursor = 0;
+      m_sectionMode = section_mode::Waiting;
+      ++m_section;
+    }
+
+    constexpr auto render_section(std::span<float> part) -> block_state
+    {
+      auto const partEnd = m_blockStartSampleNumber + static_cast<std::uint32_t>(part.size());
+
+      // the section's own events, anything queued since goes through render_events() as usual
+      if (m_sectionMode != section_mode::Waiting) {
+        auto const start = m_sections[m_section].start;
+        while (m_sectionEventCursor < m_sectionEvents.size()
+               and start + m_sectionEvents[m_sectionEventCursor].noteOn < partEnd) {
+          auto const &e = m_sectionEvents[m_sectionEventCursor++];
+          m_instrument.play_note(e.playNote, start + e.noteOn - m_blockStartSampleNumber, e.noteOff - e.noteOn);
+          m_stats.events_dispatched();
+        }
+      }
+
+      // a note queued or merged from the inbox since the section started is not part of the pattern, the
+      // take would replay it with every later play, so give up recording and try again at the next play
+      if (m_sectionMode == section_mode::Record) {
+        if (auto e = next_event(); e and e->noteOn < partEnd) {
+          auto &take = m_takes[m_sections[m_section].pattern];
+          take.events.clear();
+          take.samples.clear();
+          m_sectionMode = section_mode::Live;
+        }
+      }
+
+      auto state = render_events(part);
+      if (m_sectionMode == section_mode::Record) {
+        auto &samples = m_takes[m_sections[m_section].pattern].samples;
+        if (state == block_state::Silent) {
+          samples.resize(samples.size() + part.size(), 0.0F);
+        } else {
+          samples.insert(samples.end(), part.begin(), part.end());
+        }
+      }
+      return state;
+    }
+
+    constexpr auto replay_section(std::span<float> part) -> block_state
+    {
+      auto const &current = m_sections[m_section];
+      auto const &samples = m_takes[current.pattern].samples;
+      float const *taken = samples.data() + (m_blockStartSampleNumber - current.start);
+      auto const count = part.size();
+
+      // The instrument is idle and is left alone, unless something was queued into this section
+      // after it started, so the section's own notes report no events, voices or culls to the statistics.
+      // Plain pointers as span indexing is a call per sample in constant evaluation.
+      float *out = part.data();
+      auto e = next_event();
+      if (!e or e->noteOn >= m_blockStartSampleNumber + count) {
+        m_blockStartSampleNumber += static_cast<std::uint32_t>(count);
+        std::copy_n(taken, count, out);
+      } else if (render_events(part) == block_state::Silent) {
+        std::copy_n(taken, count, out);
+      } else {
+        for (std::size_t i{ 0 }; i < count; ++i) {
+          out[i] += taken[i];
+        }
+      }
+
+      m_reusedSamples += count;
+      return block_state::Audible;
+    }
+
+    [[nodiscard]] constexpr auto instrument_is_idle() const -> bool
+    {
+      if constexpr (requires { m_instrument.is_idle(); }) {
+        return m_instrument.is_idle();
+      } else {
+        return false;  // no way to tell, never replay
+      }
+    }
+
+    // a full order so the same events in a different order compare equal
+    struct event_order
+    {
+      constexpr auto operator()(event const &lhs, event const &rhs) const -> bool
+      {
+        return std::tuple{ lhs.noteOn, lhs.playNote.note_number, lhs.noteOff }
+               < std::tuple{ rhs.noteOn, rhs.playNote.note_number, rhs.noteOff };
+      }
+    };
+
+    static constexpr auto same_event(event const &lhs, event const &rhs) -> bool
+    {
+      return lhs.noteOn == rhs.noteOn and lhs.playNote.note_number == rhs.playNote.note_number
+             and lhs.noteOff == rhs.noteOff;
+    }
+
     struct event_min_sorter
     {
       constexpr auto operator()(event const &lhs, event const &rhs) -> bool
@@ -210,6 +756,95 @@ namespace tmp {
       }
     };
 
+    enum class event_source : std::uint8_t { None, Baked, Timeline, Queue };
+
+    // the soonest event is next in the baked table, next on the timeline or the top of the late event heap
+    [[nodiscard]] constexpr auto next_source() const -> event_source
+    {
+      auto source = event_source::None;
+      std::uint32_t soonest{ 0 };
+      auto consider = [&](event_source candidate, std::uint32_t noteOn) {
+        if (source == event_source::None or noteOn < soonest) {
+          source = candidate;
+          soonest = noteOn;
+        }
+      };
+
+      if (m_bakedCursor < m_baked.size()) {
+        consider(event_source::Baked, m_baked[m_bakedCursor].noteOn);
+      }
+      if (!timeline_is_empty()) {
+        consider(event_source::Timeline, timeline_next().noteOn);
+      }
+      if (!queue_is_empty()) {
+        consider(event_source::Queue, queue_top().noteOn);
+      }
+      return source;
+    }
+
+    // an event and where it came from, so it can be popped without choosing the source again
+    struct sourced_event : event
+    {
+      event_source source;
+    };
+
+    // by value as baked events are expanded from their compact form
+    [[nodiscard]] constexpr auto next_event() const -> std::optional<sourced_event>
+    {
+      switch (auto source = next_source()) {
+      case event_source::Baked: {
+        auto const &baked = m_baked[m_bakedCursor];
+        return sourced_event{ { note::from_number(baked.noteNumber), baked.noteOn, baked.noteOn + baked.length },
+          source };
+      }
+      case event_source::Timeline:
+        return sourced_event{ timeline_next(), source };
+      case event_source::Queue:
+        return sourced_event{ queue_top(), source };
+      case event_source::None:
+        break;
+      }
+      return std::nullopt;
+    }
+
+    // pop the event next_event() returned
+    constexpr void pop_next_event(sourced_event const &next)
+    {
+      switch (next.source) {
+      case event_source::Baked:
+        ++m_bakedCursor;
+        break;
+      case event_source::Timeline:
+        ++m_timelineCursor;
+        break;
+      case event_source::Queue:
+        queue_pop();
+        break;
+      case event_source::None:
+        break;
+      }
+    }
+
+    [[nodiscard]] constexpr auto timeline_is_empty() const -> bool
+    {
+      return m_timelineCursor == m_timeline.size();
+    }
+
+    [[nodiscard]] constexpr auto timeline_next() const -> event const &
+    {
+      return m_timeline[m_timelineCursor];
+    }
+
+    constexpr void sort_timeline()
+    {
+      // drop anything already played so it is not sorted back in front of the cursor
+      m_timeline.erase(m_timeline.begin(), m_timeline.begin() + static_cast<std::ptrdiff_t>(m_timelineCursor));
+      m_timelineCursor = 0;
+      // std::sort is not stable, the full order keeps notes that start together in a fixed order
+      std::ranges::sort(m_timeline, event_order{});
+      m_timelineSorted = true;
+    }
+
     [[nodiscard]] constexpr auto queue_is_empty() const -> bool
     {
       return m_eventQueueContainer.empty();
@@ -233,10 +868,57 @@ namespace tmp {
       m_eventQueueContainer.pop_back();
     }
 
+    enum class inbox_step : std::uint8_t { BlockStart, BlockEnd };
+
+    // Set up by attach_inbox(), where event_inbox is complete. At the start of a block live events move
+    // onto the heap while it has reserved room, anything left waits for the next block. An event stamped
+    // before the block has been missed, it plays at the start of the block instead. At the end of a block
+    // the inbox learns where the next one starts.
+    template<typename INBOX>
+    static void sync_inbox(sequencer &self, inbox_step step)
+    {
+      INBOX &inbox = *self.m_inbox;
+      if (step == inbox_step::BlockEnd) {
+        inbox.set_position(self.m_blockStartSampleNumber);
+        return;
+      }
+
+      compact_event e{};
+      auto &queue = self.m_eventQueueContainer;
+      while (queue.size() < queue.capacity() and inbox.pop(e)) {
+        auto const start = self.m_blockStartSampleNumber;
+        auto const late = start > e.noteOn ? start - e.noteOn : 0U;
+        auto const noteOn = e.noteOn + late;
+        self.queue_emplace(note::from_number(e.noteNumber), noteOn, noteOn + e.length);
+        inbox.record_merge(late);
+      }
+    }
+
     INSTRUMENT<RATE> &m_instrument;
     std::uint32_t m_blockStartSampleNumber{ 0 };
+    // Events known up front (parsed or bulk queued), sorted once by note on and consumed
+    // by moving the cursor, no heap operations per event.
+    std::vector<event> m_timeline{};
+    std::size_t m_timelineCursor{ 0 };
+    bool m_timelineSorted{ true };
+    // Events added one at a time with queue_event(), these may arrive late so are kept in a
     // min priority queue = ordered by first events to occur
     // but std::priority_queue is not constexpr
     std::vector<event> m_eventQueueContainer{};
+    // Events baked at compile time with bake_music(), not owned
+    std::span<compact_event const> m_baked{};
+    std::size_t m_bakedCursor{ 0 };
+    // Sections of an arranged score from parse_music(), empty unless a pattern plays more than once
+    std::vector<section> m_sections{};
+    std::vector<pattern_take> m_takes{};  // indexed by pattern
+    std::size_t m_section{ 0 };  // the current or next section
+    section_mode m_sectionMode{ section_mode::Waiting };
+    std::vector<event> m_sectionEvents{};  // relative to the section start
+    std::size_t m_sectionEventCursor{ 0 };
+    std::uint64_t m_reusedSamples{ 0 };
+    // Live events from other threads, not owned and not copied with the sequencer
+    event_inbox *m_inbox{ nullptr };
+    void (*m_syncInbox)(sequencer &, inbox_step){ nullptr };
+    [[no_unique_address]] detail::stats_hook<STATS> m_stats{};
   };
 }  // namespace tmp
\ No newline at end of file
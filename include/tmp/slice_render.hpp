@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "types.hpp"
+#include "wav_render.hpp"
+
+namespace tmp {
+
+  //
+  // Renders one time slice of a song at compile time, see add_wav(... SLICES ...) in CMakeLists.txt.
+  //
+  // The blocks of the whole song are shared out between SLICES slices. Slice SLICE seeks the source (a
+  // sequencer) to its first frame, which resumes the notes still sounding there with their envelopes
+  // part way through, and renders only its own blocks, so each slice costs about 1 / SLICES of the
+  // whole render and they can be compiled in parallel. The first slice starts with the header for the
+  // whole file, so the slices concatenated in order are the file wav_renderer would produce: identical
+  // for fixed point oscillators, within float rounding for sin_oscillator. With pcm_dither::Tpdf each
+  // slice starts its own noise sequence, which is as good as dither but not the same bytes.
+  //
+  // Only 16 bit PCM, there is no wav_encoding parameter: an IMA ADPCM block could span two slices and
+  // the predictor state at a slice's first frame is only known once every earlier sample is encoded.
+  //
+  template<sample_rate RATE,
+    seconds SECONDS,
+    std::size_t SLICE,
+    std::size_t SLICES,
+    std::uint16_t CHANNELS = 1,
+    block_size BLOCK_SIZE = block_size{ 128 },
+    pcm_dither DITHER = pcm_dither::None>
+  struct wav_slice_renderer
+  {
+    static_assert(SLICE < SLICES, "SLICE counts from 0 to SLICES - 1");
+
+    using Whole = wav_renderer<RATE, SECONDS, CHANNELS, BLOCK_SIZE, DITHER>;
+    using Fmt = typename Whole::Fmt;
+
+    static constexpr std::uint64_t NumBlocks = Whole::NumFrames / BLOCK_SIZE.samplesPerBlock;
+    static constexpr auto FirstFrame =
+      static_cast<std::uint32_t>(NumBlocks * SLICE / SLICES * BLOCK_SIZE.samplesPerBlock);
+    static constexpr auto EndFrame =
+      static_cast<std::uint32_t>(NumBlocks * (SLICE + 1) / SLICES * BLOCK_SIZE.samplesPerBlock);
+    static constexpr std::uint32_t NumFrames = EndFrame - FirstFrame;
+
+    static constexpr std::size_t HeaderSize = SLICE == 0 ? Whole::HeaderSize : 0;
+    static constexpr std::size_t SampleDataLength = std::size_t{ NumFrames } * Fmt::BlockAlign;
+    static constexpr std::size_t TotalSize = HeaderSize + SampleDataLength;
+
+    std::array<std::byte, TotalSize> data;
+
+    template<typename SOURCE>
+    constexpr void render(SOURCE &source)
+      requires requires(SOURCE &s) { s.seek(FirstFrame); }
+    {
+      std::span<std::byte, TotalSize> buffer{ data };
+      if constexpr (SLICE == 0) {
+        Whole::render_header(buffer.template first<HeaderSize>());
+      } else {
+        source.seek(FirstFrame);
+      }
+
+      auto sampleData = buffer.template last<SampleDataLength>();
+      detail::tpdf_noise dither{};
+      for (std::size_t frame{ 0 }; frame < NumFrames; frame += BLOCK_SIZE.samplesPerBlock) {
+        detail::render_pcm16_block<CHANNELS, BLOCK_SIZE, DITHER>(
+          source, sampleData.subspan(frame * Fmt::BlockAlign, Whole::BlockBytes), dither);
+      }
+    }
+  };
+
+}  // namespace tmp
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <numbers>
-#include <optional>
 #include <span>
 
 #include "types.hpp"
@@ -27,24 +29,448 @@ namespace tmp::sources {
 
     template<block_size BLOCK_SIZE>
     constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+    {
+      render(std::span<float>{ buffer });
+    }
+
+    constexpr void render(std::span<float> buffer)
     {
       for (auto &sample : buffer) {
         sample = m_volume.value * std::sin(m_theta);
         m_theta += m_deltaTheta;
       }
 
-      // keep theta between 0..Tau (2 pi)
-      while (m_theta > Tau) {
-        m_theta -= Tau;
+      wrap();
+    }
+
+    // Add to the buffer instead of overwriting it, scaled by a gain that moves by `gainStep` each
+    // sample, buffer[i] += sample * (gain + gainStep * (i + 1)). Notes apply their envelope with this.
+    constexpr void render_add(std::span<float> buffer, float gain = 1.0F, float gainStep = 0.0F)
+    {
+      float *out = buffer.data();
+      for (std::size_t i{ 0 }; i < buffer.size(); ++i) {
+        out[i] += (m_volume.value * std::sin(m_theta)) * (gain + (gainStep * static_cast<float>(i + 1)));
+        m_theta += m_deltaTheta;
+      }
+
+      wrap();
+    }
+
+    // Advance as though `samples` samples had been rendered, accumulated the same way as render()
+    constexpr void skip(std::uint32_t samples)
+    {
+      for (std::uint32_t i{ 0 }; i < samples; ++i) {
+        m_theta += m_deltaTheta;
       }
+
+      wrap();
+    }
+
+    // Set the phase for the next rendered sample to be `position` samples after the note on,
+    // negative when the note on is later in the next block. The phase is then zero at the note on.
+    constexpr void seek(std::int64_t position)
+    {
+      auto theta = std::fmod(static_cast<double>(position) * m_deltaTheta, static_cast<double>(Tau));
+      m_theta = static_cast<float>(theta < 0.0 ? theta + Tau : theta);
+    }
+
+    // stateless sample for a 32 bit fixed point phase (2^32 == Tau), used by the voice_bank
+    static constexpr auto wave(std::uint32_t phase) -> float
+    {
+      return std::sin(static_cast<float>(phase) * (Tau / 4294967296.0F));
     }
 
   private:
     float m_deltaTheta;
     volume m_volume;
     float m_theta{ 0.0F };
+
+    // keep theta between 0..Tau (2 pi)
+    constexpr void wrap()
+    {
+      while (m_theta > Tau) {
+        m_theta -= Tau;
+      }
+    }
+  };
+
+
+  //
+  // Wavetable oscillator, a drop in replacement for sin_oscillator that avoids calling std::sin()
+  // per sample. A single cycle of a sine wave is generated at compile time into a table of
+  // TABLE_SIZE entries (plus one guard entry so interpolation never needs to wrap).
+  //
+  // The phase is held in a 32 bit fixed point accumulator, the top log2(TABLE_SIZE) bits are the
+  // table index and the remaining bits are the fraction between entries. This wraps for free and
+  // does not drift like accumulating a float angle does.
+  //
+  // Worst case error against std::sin() for a full scale output (before volume is applied):
+  //
+  //   interpolation::Nearest   pi / N            N = 1024: ~3.1e-3 (-50 dB)   N = 4096: ~7.7e-4 (-62 dB)
+  //   interpolation::Linear    pi^2 / (2 N^2)    N = 1024: ~4.7e-6 (-106 dB)  N = 4096: ~3.5e-7 (-129 dB)
+  //
+  // For linear interpolation the float rounding of the table and the sample (~3e-7) is the floor at
+  // 4096 entries, going any larger only costs table generation time at compile time.
+  //
+  enum class interpolation : std::uint8_t { Nearest, Linear };
+
+  namespace detail {
+    // The 32 bit fixed point phase step for a frequency, 2^32 is one cycle. Only the fraction of a cycle
+    // per sample is kept, a note at or above the sample rate (C9 at 8 kHz) would overflow the cast.
+    constexpr auto phase_increment(frequency freq, sample_rate rate) -> std::uint32_t
+    {
+      auto const cycles = std::fmod(static_cast<double>(freq.hertz) / rate.samples_per_second, 1.0);
+      return static_cast<std::uint32_t>(static_cast<std::uint64_t>((cycles * 4294967296.0) + 0.5));
+    }
+  }  // namespace detail
+
+  template<sample_rate RATE, std::size_t TABLE_SIZE = 1024, interpolation INTERPOLATION = interpolation::Linear>
+  class wavetable_oscillator
+  {
+    static_assert(TABLE_SIZE >= 4 and std::has_single_bit(TABLE_SIZE), "Table size must be a power of 2");
+
+    static constexpr std::uint32_t IndexBits = std::countr_zero(TABLE_SIZE);
+    static constexpr std::uint32_t FractionBits = 32 - IndexBits;
+    static constexpr float FractionScale = 1.0F / static_cast<float>(1ULL << FractionBits);
+
+    static constexpr auto generate_table() -> std::array<float, TABLE_SIZE + 1>
+    {
+      std::array<float, TABLE_SIZE + 1> table{};
+      for (std::size_t i{ 0 }; i < TABLE_SIZE; ++i) {
+        // compute in double so the table entries are correctly rounded floats
+        table[i] = static_cast<float>(
+          std::sin(2.0 * std::numbers::pi * static_cast<double>(i) / static_cast<double>(TABLE_SIZE)));
+      }
+      table[TABLE_SIZE] = table[0];  // guard point for interpolation
+      return table;
+    }
+
+    static constexpr std::array<float, TABLE_SIZE + 1> Table = generate_table();
+
+  public:
+    constexpr wavetable_oscillator(frequency freq, volume vol)
+      : m_deltaPhase{ detail::phase_increment(freq, RATE) }
+      , m_volume{ vol }
+    {}
+
+    template<block_size BLOCK_SIZE>
+    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+    {
+      render(std::span<float>{ buffer });
+    }
+
+    constexpr void render(std::span<float> buffer)
+    {
+      // Work on raw pointers and locals, this is the hot loop and during constant evaluation every
+      // iterator increment and operator[] call is interpreted, costing more than the math.
+      float *out = buffer.data();
+      float const *table = Table.data();
+      float const level = m_volume.value;
+      std::uint32_t phase = m_phase;
+
+      for (std::size_t i{ 0 }; i < buffer.size(); ++i) {
+        out[i] = level * lookup(table, phase);
+        phase += m_deltaPhase;  // wraps at 2^32 == Tau
+      }
+
+      m_phase = phase;
+    }
+
+    // Add to the buffer instead of overwriting it, scaled by a gain that moves by `gainStep` each
+    // sample, buffer[i] += sample * (gain + gainStep * (i + 1)). Notes apply their envelope with this.
+    constexpr void render_add(std::span<float> buffer, float gain = 1.0F, float gainStep = 0.0F)
+    {
+      float *out = buffer.data();
+      float const *table = Table.data();
+      float const level = m_volume.value;
+      std::uint32_t phase = m_phase;
+
+      for (std::size_t i{ 0 }; i < buffer.size(); ++i) {
+        out[i] += (level * lookup(table, phase)) * (gain + (gainStep * static_cast<float>(i + 1)));
+        phase += m_deltaPhase;
+      }
+
+      m_phase = phase;
+    }
+
+    // Advance as though `samples` samples had been rendered
+    constexpr void skip(std::uint32_t samples)
+    {
+      m_phase += m_deltaPhase * samples;
+    }
+
+    // Set the phase for the next rendered sample to be `position` samples after the note on,
+    // negative when the note on is later in the next block. The phase is then zero at the note on.
+    constexpr void seek(std::int64_t position)
+    {
+      // modulo 2^32 arithmetic, exact for any position
+      m_phase = static_cast<std::uint32_t>(static_cast<std::uint64_t>(position) * m_deltaPhase);
+    }
+
+    // stateless sample for a 32 bit fixed point phase (2^32 == Tau), used by the voice_bank
+    static constexpr auto wave(std::uint32_t phase) -> float
+    {
+      return lookup(Table.data(), phase);
+    }
+
+  private:
+    std::uint32_t m_deltaPhase;
+    volume m_volume;
+    std::uint32_t m_phase{ 0 };
+
+    static constexpr auto lookup(float const *table, std::uint32_t phase) -> float
+    {
+      if constexpr (INTERPOLATION == interpolation::Nearest) {
+        // round to the closest entry, the guard point covers rounding up past the last entry
+        auto index = (static_cast<std::uint64_t>(phase) + (1U << (FractionBits - 1))) >> FractionBits;
+        return table[index];
+      } else {
+        auto index = phase >> FractionBits;
+        auto fraction = static_cast<float>(phase & ((1U << FractionBits) - 1)) * FractionScale;
+        auto a = table[index];
+        auto b = table[index + 1];
+        return a + ((b - a) * fraction);
+      }
+    }
+  };
+
+
+  //
+  // Band limited saw, square and triangle oscillators using PolyBLEP. The naive waveform is
+  // computed from the phase and the discontinuity at each step (saw, square) or corner (triangle)
+  // is smoothed with a two sample polynomial residual, which removes most of the aliasing a naive
+  // waveform has for about the cost of one sine. The additive equivalent needs one sine per partial
+  // below Nyquist. Aliased power relative to the harmonics, 3170 Hz at 48 kHz:
+  //
+  //   saw        naive -10.6 dB   PolyBLEP -26.1 dB
+  //   square     naive -12.8 dB   PolyBLEP -30.5 dB
+  //   triangle   naive -35.1 dB   PolyBLAMP -49.4 dB
+  //
+  //   saw        ramps from -1 to 1, harmonics 1/n
+  //   square     +1 for the first half cycle then -1, odd harmonics 1/n
+  //   triangle   from -1 up to 1 at half a cycle and back, odd harmonics 1/n^2 (PolyBLAMP corners)
+  //
+  // The phase is a 32 bit fixed point accumulator like wavetable_oscillator, so seek() is exact and
+  // the state fits the note cache. The output is full scale before volume, a saw or square at the
+  // same volume sounds louder than a sine.
+  //
+  enum class waveform : std::uint8_t { Saw, Square, Triangle };
+
+  template<sample_rate RATE, waveform WAVEFORM>
+  class polyblep_oscillator
+  {
+    static constexpr float PhaseToFloat = 1.0F / 4294967296.0F;
+    static constexpr std::uint32_t HalfCycle = 0x8000'0000U;
+
+  public:
+    constexpr polyblep_oscillator(frequency freq, volume vol)
+      : m_deltaPhase{ detail::phase_increment(freq, RATE) }
+      , m_dt{ static_cast<float>(m_deltaPhase) * PhaseToFloat }
+      , m_volume{ vol }
+    {}
+
+    template<block_size BLOCK_SIZE>
+    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+    {
+      render(std::span<float>{ buffer });
+    }
+
+    constexpr void render(std::span<float> buffer)
+    {
+      // raw pointers and locals for the same reason as wavetable_oscillator
+      float *out = buffer.data();
+      float const level = m_volume.value;
+      std::uint32_t phase = m_phase;
+
+      for (std::size_t i{ 0 }; i < buffer.size(); ++i) {
+        out[i] = level * wave(phase, m_dt);
+        phase += m_deltaPhase;
+      }
+
+      m_phase = phase;
+    }
+
+    // Add to the buffer instead of overwriting it, scaled by a gain that moves by `gainStep` each
+    // sample, buffer[i] += sample * (gain + gainStep * (i + 1)). Notes apply their envelope with this.
+    constexpr void render_add(std::span<float> buffer, float gain = 1.0F, float gainStep = 0.0F)
+    {
+      float *out = buffer.data();
+      float const level = m_volume.value;
+      std::uint32_t phase = m_phase;
+
+      for (std::size_t i{ 0 }; i < buffer.size(); ++i) {
+        out[i] += (level * wave(phase, m_dt)) * (gain + (gainStep * static_cast<float>(i + 1)));
+        phase += m_deltaPhase;
+      }
+
+      m_phase = phase;
+    }
+
+    // Advance as though `samples` samples had been rendered
+    constexpr void skip(std::uint32_t samples)
+    {
+      m_phase += m_deltaPhase * samples;
+    }
+
+    // Set the phase for the next rendered sample to be `position` samples after the note on,
+    // negative when the note on is later in the next block. The phase is then zero at the note on.
+    constexpr void seek(std::int64_t position)
+    {
+      m_phase = static_cast<std::uint32_t>(static_cast<std::uint64_t>(position) * m_deltaPhase);
+    }
+
+  private:
+    std::uint32_t m_deltaPhase;
+    float m_dt;  // phase increment as a fraction of a cycle
+    volume m_volume;
+    std::uint32_t m_phase{ 0 };
+
+    static constexpr auto wave(std::uint32_t phase, float dt) -> float
+    {
+      float const t = static_cast<float>(phase) * PhaseToFloat;
+      if constexpr (WAVEFORM == waveform::Saw) {
+        return (2.0F * t) - 1.0F - blep(t, dt);
+      } else if constexpr (WAVEFORM == waveform::Square) {
+        // the half is chosen on the fixed point phase, t can round up to 0.5 just before the step
+        float const half = static_cast<float>(phase + HalfCycle) * PhaseToFloat;
+        return (phase < HalfCycle ? 1.0F : -1.0F) + blep(t, dt) - blep(half, dt);
+      } else {
+        // the slope changes by 8 per cycle at each corner, 8 * dt per sample
+        float const half = static_cast<float>(phase + HalfCycle) * PhaseToFloat;
+        float const naive = phase < HalfCycle ? (4.0F * t) - 1.0F : 3.0F - (4.0F * t);
+        return naive + (8.0F * dt * (blamp(t, dt) - blamp(half, dt)));
+      }
+    }
+
+    // residual of a step from -1 to 1 at t == 0, non zero within one sample either side
+    static constexpr auto blep(float t, float dt) -> float
+    {
+      if (t < dt) {
+        float const x = t / dt;
+        return (x + x) - (x * x) - 1.0F;
+      }
+      if (t > 1.0F - dt) {
+        float const x = (t - 1.0F) / dt;
+        return (x * x) + (x + x) + 1.0F;
+      }
+      return 0.0F;
+    }
+
+    // residual of a change in slope of 1 per sample at t == 0, the integral of half a blep
+    static constexpr auto blamp(float t, float dt) -> float
+    {
+      if (t < dt) {
+        float const x = (t / dt) - 1.0F;
+        return -(x * x * x) / 6.0F;
+      }
+      if (t > 1.0F - dt) {
+        float const x = ((t - 1.0F) / dt) + 1.0F;
+        return (x * x * x) / 6.0F;
+      }
+      return 0.0F;
+    }
   };
 
+  template<sample_rate RATE>
+  using saw_oscillator = polyblep_oscillator<RATE, waveform::Saw>;
+
+  template<sample_rate RATE>
+  using square_oscillator = polyblep_oscillator<RATE, waveform::Square>;
+
+  template<sample_rate RATE>
+  using triangle_oscillator = polyblep_oscillator<RATE, waveform::Triangle>;
+
+
+  namespace detail {
+    enum class envelope_state : std::uint8_t { Wait = 0, Attack = 1, Decay = 2, Sustain = 3, Release = 4, Idle = 5 };
+
+    // A stretch of samples where the envelope level changes by a constant step per sample
+    struct envelope_segment
+    {
+      envelope_state state;
+      float level;  // level before the first sample of the segment
+      float step;  // added to the level before each sample
+      std::uint32_t samples;
+    };
+
+    //
+    // The envelope timings converted to whole numbers of samples. Knowing how long each
+    // segment lasts up front lets a whole segment be processed as one loop instead of
+    // checking for a state change on every sample.
+    //
+    template<sample_rate RATE>
+    class envelope_segments
+    {
+    public:
+      static constexpr std::uint32_t Forever = std::numeric_limits<std::uint32_t>::max();
+
+      constexpr explicit envelope_segments(envelope env)
+        : m_attackLevel{ env.attackLevel.value }
+        , m_decayLevel{ env.decayLevel.value }
+        , m_attackSamples{ segment_samples(env.attackTime) }
+        , m_decaySamples{ segment_samples(env.decayTime) }
+        , m_attackStep{ env.attackLevel.value / static_cast<float>(m_attackSamples) }
+        , m_decayStep{ (env.decayLevel.value - env.attackLevel.value) / static_cast<float>(m_decaySamples) }
+        , m_releaseStep{ -env.decayLevel.value / static_cast<float>(segment_samples(env.releaseTime)) }
+      {}
+
+      // The segment that follows `current` once it has run its course. `level` is where the current
+      // segment finished and `untilOff` the number of samples left before the note off.
+      [[nodiscard]] constexpr auto next(envelope_state current, float level, std::uint32_t untilOff) const
+        -> envelope_segment
+      {
+        switch (current) {
+        case envelope_state::Wait:
+          return { envelope_state::Attack, 0.0F, m_attackStep, std::min(m_attackSamples, untilOff) };
+
+        case envelope_state::Attack:
+          if (untilOff == 0) {
+            return release(level);
+          }
+          return { envelope_state::Decay, m_attackLevel, m_decayStep, std::min(m_decaySamples, untilOff) };
+
+        case envelope_state::Decay:
+          if (untilOff == 0) {
+            return release(level);
+          }
+          return { envelope_state::Sustain, m_decayLevel, 0.0F, untilOff };
+
+        case envelope_state::Sustain:
+          return release(level);
+
+        case envelope_state::Release:
+        case envelope_state::Idle:
+          break;
+        }
+        return { envelope_state::Idle, 0.0F, 0.0F, Forever };
+      }
+
+    private:
+      float m_attackLevel;
+      float m_decayLevel;
+      std::uint32_t m_attackSamples;
+      std::uint32_t m_decaySamples;
+      float m_attackStep;
+      float m_decayStep;
+      float m_releaseStep;
+
+      static constexpr auto segment_samples(seconds time) -> std::uint32_t
+      {
+        return std::max<std::uint32_t>(1, time.to_samples(RATE));
+      }
+
+      [[nodiscard]] constexpr auto release(float level) const -> envelope_segment
+      {
+        // ramp down from wherever the note got to at the release slope
+        std::uint32_t samples{ 0 };
+        if (m_releaseStep < 0.0F and level > 0.0F) {
+          samples = static_cast<std::uint32_t>(std::ceil(level / -m_releaseStep));
+        }
+        return { envelope_state::Release, level, m_releaseStep, samples };
+      }
+    };
+  }  // namespace detail
+
 
   //
   // Envelope generator. Configure then call note_on() to start the envelope_generator
@@ -52,18 +478,16 @@ namespace tmp::sources {
   //
   // is_idle() will indicate when the envelope_generator is complete.
   //
+  // Each segment (wait, attack, decay, sustain, release) has a known length in samples, so a
+  // block is processed as a few runs: a fill for silence, a constant scale for sustain and an
+  // arithmetic ramp for the others. There is no per sample state checking so the loops vectorise.
+  //
   template<sample_rate RATE>
   class envelope_generator
   {
   public:
     constexpr envelope_generator(envelope env)
-      : m_deltas({
-          { 0.0F, 0.0F }, // wait / idle
-          { compute_slope(volume{ 0.0F }, env.attackLevel, env.attackTime), env.attackLevel.value }, // Attack
-          { compute_slope(env.attackLevel, env.decayLevel, env.decayTime), env.decayLevel.value }, // Decay
-          { 0.0F, env.decayLevel.value }, // Sustain
-          { compute_slope(env.decayLevel, volume{ 0.0F }, env.releaseTime), 0.0F }  // Release
-    })
+      : m_segments{ env }
     {}
 
     [[nodiscard]] constexpr auto is_idle() const
@@ -74,130 +498,129 @@ namespace tmp::sources {
     // begin the note envelope_generator in the given number of samples from the start of the next apply() block
     constexpr void note_on(std::uint32_t startNumberSamplesFromNextBlock, std::uint32_t stopAfterNumberSamples)
     {
-      m_sampleCounter = startNumberSamplesFromNextBlock;
-      m_offSampleCounter = stopAfterNumberSamples;
+      // the note on sample itself is silent, then attack, decay and sustain last for
+      // stopAfterNumberSamples + 1 samples before the release.
       m_state = State::Wait;
+      m_level = 0.0F;
+      m_step = 0.0F;
+      m_remaining = startNumberSamplesFromNextBlock + 1;
+      m_untilOff = stopAfterNumberSamples + 1;
+    }
+
+    // Advance the envelope as though `samples` samples had been rendered, without rendering them
+    constexpr void skip(std::uint64_t samples)
+    {
+      while (samples > 0 and m_state != State::Idle) {
+        auto run = static_cast<std::uint32_t>(std::min<std::uint64_t>(m_remaining, samples));
+        m_level += m_step * static_cast<float>(run);
+        samples -= run;
+        consume(run);
+      }
     }
 
     template<block_size BLOCK_SIZE>
     constexpr void apply(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
     {
-      for (std::size_t i{ 0 }; i < BLOCK_SIZE.samplesPerBlock; ++i) {
-        // Wait -> Attack [note on]
-        // Attack -> Release [note off]
-        // Decay -> Release [note off]
-        // Sustain -> Release [note off]
-        // Release -> Idle
+      apply(std::span<float>{ buffer });
+    }
 
-        // otherwise apply the current delta
-        // check for state increment if current matches delta target
-        switch (m_state) {
-        case State::Wait:
-        case State::Idle:
-          buffer[i] = 0.0F;  // silence
-          if (handle_note_command(State::Attack)) {  // note on?
-            // we know the note length so configure the counter
-            // to trip to release after that time.
-            m_sampleCounter = m_offSampleCounter;
+    constexpr void apply(std::span<float> buffer)
+    {
+      float *samples = buffer.data();
+      for_each_run(
+        static_cast<std::uint32_t>(buffer.size()),
+        [samples](std::uint32_t offset, std::uint32_t run, float level, float step) {
+          if (step == 0.0F) {
+            scale(samples + offset, run, level);
+          } else {
+            ramp(samples + offset, run, level, step);
           }
-          break;
+        },
+        [samples](std::uint32_t offset, std::uint32_t run) {
+          std::fill_n(samples + offset, run, 0.0F);  // silence
+        });
+    }
 
-        case State::Attack:
-          buffer[i] *= handle_up_ramp(State::Decay);
-          handle_note_command(State::Release);  // note off?
-          break;
+    // Walk the next `samples` samples a run at a time, calling audible(offset, run, level, step) where the
+    // envelope is level + step * (i + 1) (step is 0 while sustaining) and silent(offset, run) before the
+    // note starts and after it ends. This lets a note fold its envelope into rendering the oscillator.
+    template<typename AUDIBLE, typename SILENT>
+    constexpr void for_each_run(std::uint32_t samples, AUDIBLE &&audible, SILENT &&silent)
+    {
+      std::uint32_t offset{ 0 };
+      while (offset < samples) {
+        auto run = std::min(m_remaining, samples - offset);
 
-        case State::Decay:
-          buffer[i] *= handle_down_ramp(State::Sustain);
-          handle_note_command(State::Release);  // note off?
+        switch (m_state) {
+        case State::Wait:
+        case State::Idle:
+          silent(offset, run);
           break;
 
         case State::Sustain:
-          buffer[i] *= handle_sustain();
-          handle_note_command(State::Release);  // note off?
+          audible(offset, run, m_level, 0.0F);
           break;
 
+        case State::Attack:
+        case State::Decay:
         case State::Release:
-          buffer[i] *= handle_down_ramp(State::Idle);
+          audible(offset, run, m_level, m_step);
+          // the level the run ended on, accumulated once per run so a ramp split over blocks gathers a
+          // rounding per block
+          m_level += m_step * static_cast<float>(run);
           break;
         }
+
+        offset += run;
+        consume(run);
       }
     }
 
   private:
-    enum class State : std::uint8_t { Wait = 0, Attack = 1, Decay = 2, Sustain = 3, Release = 4, Idle = 5 };
-
-    struct delta
-    {
-      float increment_per_sample;
-      float target_value;
-    };
+    using State = detail::envelope_state;
 
+    detail::envelope_segments<RATE> m_segments;
     State m_state{ State::Wait };
-    float m_lastLevel{ 0.0F };
-    std::optional<std::uint32_t> m_sampleCounter{};
-    std::uint32_t m_offSampleCounter{};
-    std::array<delta, 5> m_deltas;
-
-    constexpr auto handle_note_command(State nextState) -> bool
-    {
-      if (m_sampleCounter.has_value()) {
-        if (m_sampleCounter.value() == 0) {
-          // yes, time to change state
-          m_state = nextState;
-          m_sampleCounter.reset();
-          return true;
-        } else {
-          // keep waiting for state change
-          --m_sampleCounter.value();
-        }
-      }
-      return false;
-    }
+    float m_level{ 0.0F };
+    float m_step{ 0.0F };
+    std::uint32_t m_remaining{ detail::envelope_segments<RATE>::Forever };  // samples left in this segment
+    std::uint32_t m_untilOff{ 0 };  // samples left before the note off, counted from the attack
 
-    constexpr auto handle_up_ramp(State nextState) -> float
+    constexpr void consume(std::uint32_t samples)
     {
-      auto delta = get_delta();
-      m_lastLevel += delta.increment_per_sample;
-
-      if (m_lastLevel >= delta.target_value) {
-        m_state = nextState;
+      if (m_state == State::Idle) {
+        return;
       }
 
-      return m_lastLevel;
-    }
-
-    constexpr auto handle_down_ramp(State nextState) -> float
-    {
-      auto delta = get_delta();
-      m_lastLevel += delta.increment_per_sample;
-
-      if (m_lastLevel <= delta.target_value) {
-        m_state = nextState;
+      m_remaining -= samples;
+      if (m_state != State::Wait and m_state != State::Release) {
+        m_untilOff -= samples;
       }
 
-      return m_lastLevel;
-    }
-
-    constexpr auto handle_sustain() -> float
-    {
-      auto delta = get_delta();
-      return delta.target_value;
+      // zero length segments are skipped straight over
+      while (m_remaining == 0) {
+        auto next = m_segments.next(m_state, m_level, m_untilOff);
+        m_state = next.state;
+        m_level = next.level;
+        m_step = next.step;
+        m_remaining = next.samples;
+      }
     }
 
-    constexpr auto get_delta() -> delta const &
+    static constexpr void scale(float *samples, std::uint32_t count, float level)
     {
-      int index = static_cast<int>(m_state);
-      if (m_state == State::Idle) {
-        index = 0;
-      }  // reuse wait
-      return m_deltas[index];
+      for (std::uint32_t i{ 0 }; i < count; ++i) {
+        samples[i] *= level;
+      }
     }
 
-    constexpr auto compute_slope(volume startLevel, volume targetLevel, seconds time) -> float
+    static constexpr void ramp(float *samples, std::uint32_t count, float start, float step)
     {
-      auto delta = targetLevel.value - startLevel.value;
-      return delta / time.to_samples(RATE);
+      // level is computed from the segment start rather than accumulated, so there is no loop carried
+      // dependency and no rounding drift along long ramps
+      for (std::uint32_t i{ 0 }; i < count; ++i) {
+        samples[i] *= start + (step * static_cast<float>(i + 1));
+      }
     }
   };
 
@@ -213,14 +636,35 @@ namespace tmp::sources {
       : m_envelope{ envelope }
       , m_source{ std::forward<ARGS>(args)... }
     {
-      m_envelope.note_on(startNumberSamplesFromNextBlock, stopAfterNumberSamples);
+      note_on(startNumberSamplesFromNextBlock, stopAfterNumberSamples);
     }
 
     template<block_size BLOCK_SIZE>
-    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+    constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
     {
-      m_source.template render<BLOCK_SIZE>(buffer);
-      m_envelope.template apply<BLOCK_SIZE>(buffer);
+      return render(std::span<float>{ buffer });
+    }
+
+    constexpr auto render(std::span<float> buffer) -> block_state
+    {
+      std::ranges::fill(buffer, 0.0F);
+      return render_add(buffer);
+    }
+
+    // Add the note to the buffer, the oscillator, envelope and gain are applied in the one pass
+    constexpr auto render_add(std::span<float> buffer, float gain = 1.0F) -> block_state
+    {
+      if (m_envelope.is_idle()) {
+        return block_state::Silent;
+      }
+
+      m_envelope.for_each_run(
+        static_cast<std::uint32_t>(buffer.size()),
+        [&](std::uint32_t offset, std::uint32_t run, float level, float step) {
+          m_source.render_add(buffer.subspan(offset, run), level * gain, step * gain);
+        },
+        [&](std::uint32_t, std::uint32_t run) { m_source.skip(run); });
+      return block_state::Audible;
     }
 
 
@@ -233,6 +677,20 @@ namespace tmp::sources {
     constexpr void note_on(std::uint32_t inNumberSamples, std::uint32_t offAfterNumberSamples)
     {
       m_envelope.note_on(inNumberSamples, offAfterNumberSamples);
+
+      // start the waveform at the note on, not at the start of the block
+      if constexpr (requires { m_source.seek(std::int64_t{}); }) {
+        m_source.seek(-static_cast<std::int64_t>(inNumberSamples));
+      }
+    }
+
+    // Begin the note as though the note on happened `samplesSinceNoteOn` samples before the next block,
+    // used to start rendering part way through a song. The source must support seek().
+    constexpr void resume(std::uint32_t samplesSinceNoteOn, std::uint32_t offAfterNumberSamples)
+    {
+      m_envelope.note_on(0, offAfterNumberSamples);
+      m_envelope.skip(samplesSinceNoteOn);
+      m_source.seek(samplesSinceNoteOn);
     }
 
   private:
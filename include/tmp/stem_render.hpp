@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+#include "types.hpp"
+#include "wav_render.hpp"
+
+namespace tmp {
+
+  namespace detail {
+    //
+    // A stem is one part of a song rendered to 32 bit float PCM (interleaved for stereo) so stems can be
+    // summed without losing precision before the final 16 bit encode. It starts with a 16 byte header:
+    //
+    //   "TMPS"  u32 sample rate  u16 channels  u16 bits per sample (32)  u32 frames
+    //
+    // all little endian except the id.
+    //
+    struct stem_header
+    {
+      constexpr static std::uint32_t Size = 16;
+      constexpr static std::uint32_t Id = 0x544d5053;  // "TMPS", big endian
+      constexpr static std::uint16_t BitsPerSample = 32;
+
+      std::uint32_t sampleRate;
+      std::uint16_t channels;
+      std::uint32_t frames;
+
+      constexpr void render(std::span<std::byte, Size> buffer) const
+      {
+        detail::write_be(buffer.subspan<0, 4>(), Id);
+        detail::write_le(buffer.subspan<4, 4>(), sampleRate);
+        detail::write_le(buffer.subspan<8, 2>(), channels);
+        detail::write_le(buffer.subspan<10, 2>(), BitsPerSample);
+        detail::write_le(buffer.subspan<12, 4>(), frames);
+      }
+
+      static constexpr auto parse(std::span<std::byte const> buffer) -> stem_header
+      {
+        if (buffer.size() < Size or read_le32(buffer.subspan(0, 4)) != std::byteswap(Id)) {
+          throw std::invalid_argument{ "not a stem, missing TMPS header" };
+        }
+        if (read_le16(buffer.subspan(10, 2)) != BitsPerSample) {
+          throw std::invalid_argument{ "stem is not 32 bit float" };
+        }
+
+        stem_header header{ read_le32(buffer.subspan(4, 4)),
+          read_le16(buffer.subspan(8, 2)),
+          read_le32(buffer.subspan(12, 4)) };
+        if (buffer.size() < Size + (std::size_t{ header.frames } * header.channels * 4)) {
+          throw std::invalid_argument{ "stem is shorter than its header says" };
+        }
+        return header;
+      }
+
+      static constexpr auto read_le16(std::span<std::byte const> buffer) -> std::uint16_t
+      {
+        return static_cast<std::uint16_t>(std::to_integer<std::uint16_t>(buffer[0])
+                                          | (std::to_integer<std::uint16_t>(buffer[1]) << 8U));
+      }
+
+      static constexpr auto read_le32(std::span<std::byte const> buffer) -> std::uint32_t
+      {
+        return std::to_integer<std::uint32_t>(buffer[0]) | (std::to_integer<std::uint32_t>(buffer[1]) << 8U)
+               | (std::to_integer<std::uint32_t>(buffer[2]) << 16U)
+               | (std::to_integer<std::uint32_t>(buffer[3]) << 24U);
+      }
+    };
+
+    constexpr static void encode_float32(std::span<float const> samples, std::span<std::byte> buffer)
+    {
+      for (std::size_t i{ 0 }; i < samples.size(); ++i) {
+        detail::write_le(buffer.subspan(i * 4, 4), std::bit_cast<std::uint32_t>(samples[i]));
+      }
+    }
+  }  // namespace detail
+
+
+  //
+  // Renders one stem of a song at compile time, see add_wav(... STEMS ...) in CMakeLists.txt.
+  // Like wav_renderer, a stereo_source is written interleaved and a mono source goes to both channels.
+  //
+  template<sample_rate RATE,
+    seconds SECONDS,
+    std::uint16_t CHANNELS = 1,
+    block_size BLOCK_SIZE = block_size{ 128 }>
+  struct stem_renderer
+  {
+    static_assert(CHANNELS == 1 or CHANNELS == 2, "Only mono and stereo are supported");
+
+    using Header = detail::stem_header;
+
+    using Fmt = detail::wav_fmt_chunk<RATE, CHANNELS>;
+
+    static constexpr std::uint32_t NumFrames = Fmt::number_frames(SECONDS, BLOCK_SIZE);
+    static constexpr std::size_t SampleDataLength = std::size_t{ NumFrames } * CHANNELS * 4;
+    static constexpr std::size_t TotalSize = Header::Size + SampleDataLength;
+
+    std::array<std::byte, TotalSize> data;
+
+    template<typename SOURCE>
+    constexpr void render(SOURCE &source)
+    {
+      std::span<std::byte, TotalSize> buffer{ data };
+      Header{ RATE.samples_per_second, CHANNELS, NumFrames }.render(buffer.template first<Header::Size>());
+
+      auto sampleData = buffer.template last<SampleDataLength>();
+      std::array<float, BLOCK_SIZE.samplesPerBlock> left{};
+      std::array<float, BLOCK_SIZE.samplesPerBlock * CHANNELS> frames{};
+
+      for (std::size_t frame{ 0 }; frame < NumFrames; frame += BLOCK_SIZE.samplesPerBlock) {
+        auto out = sampleData.subspan(frame * CHANNELS * 4, frames.size() * 4);
+
+        if constexpr (CHANNELS == 1) {
+          detail::render_block<BLOCK_SIZE>(source, frames);
+        } else if constexpr (detail::stereo_source<SOURCE, BLOCK_SIZE>) {
+          std::array<float, BLOCK_SIZE.samplesPerBlock> right{};
+          source.template render_stereo<BLOCK_SIZE>(left, right);
+          for (std::size_t i{ 0 }; i < left.size(); ++i) {
+            frames[i * 2] = left[i];
+            frames[(i * 2) + 1] = right[i];
+          }
+        } else {
+          detail::render_block<BLOCK_SIZE>(source, left);
+          for (std::size_t i{ 0 }; i < left.size(); ++i) {
+            frames[i * 2] = left[i];
+            frames[(i * 2) + 1] = left[i];
+          }
+        }
+
+        detail::encode_float32(frames, out);
+      }
+    }
+  };
+
+}  // namespace tmp
@@ -6,8 +6,11 @@
 #include <cstdint>
 #include <span>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
+#include "note_cache.hpp"
+#include "render_stats.hpp"
 #include "sources.hpp"
 #include "types.hpp"
 
@@ -16,45 +19,193 @@ namespace tmp {
     //
     // A simple synthesiser using sine wave oscillators
     //
-    template<sample_rate RATE, template<sample_rate> typename OSCILLATOR>
+    // With note_caching::Memoize each distinct note is rendered once into a note_cache and every
+    // later occurrence is mixed from it, see note_cache.hpp.
+    //
+    // STATS reports voices started and culled and the render time to a render_stats given to
+    // attach_stats(), the default no_render_stats compiles all of that away (see traced_synth).
+    //
+    template<sample_rate RATE,
+      template<sample_rate>
+      typename OSCILLATOR,
+      note_caching CACHING = note_caching::None,
+      typename STATS = no_render_stats>
     class synth_base
     {
     public:
+      using stats_type = STATS;
+
       constexpr explicit synth_base(envelope env, volume vol)
         : m_envelope{ env }
         , m_volume{ vol }
+        , m_cache{ env, vol }
       {}
 
       template<block_size BLOCK_SIZE>
-      constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+      constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+      {
+        return render(std::span<float>{ buffer });
+      }
+
+      constexpr auto render(std::span<float> buffer) -> block_state
       {
         std::ranges::fill(buffer, 0.0F);  // zero the output buffer before rendering
+        return render_add(buffer);
+      }
+
+      // each note adds itself straight into the buffer, there is no per note temporary
+      constexpr auto render_add(std::span<float> buffer, float gain = 1.0F) -> block_state
+      {
+        [[maybe_unused]] auto timer = m_stats.time(render_stage::Synth);
+        auto const samples = static_cast<std::uint32_t>(buffer.size());
+        activate_notes(samples);
+        m_blockStartSampleNumber += samples;
+
+        if (m_playingNotes.empty() and m_cachedNotes.empty()) {
+          return block_state::Silent;
+        }
+
+        if constexpr (CACHING == note_caching::Memoize) {
+          render_cached_notes(buffer, gain);
+        }
 
         for (auto &note : m_playingNotes) {
-          std::array<float, BLOCK_SIZE.samplesPerBlock> sampleBuffer;
-          note.template render<BLOCK_SIZE>(sampleBuffer);
-          for (std::size_t i{ 0 }; i < BLOCK_SIZE.samplesPerBlock; ++i) {
-            buffer[i] = buffer[i] + sampleBuffer[i];
-          }
+          note.render_add(buffer, gain);
         }
 
         // remove idle music
-        std::erase_if(m_playingNotes, [](auto &note) { return note.is_idle(); });
+        m_stats.voices_culled(
+          static_cast<std::uint32_t>(std::erase_if(m_playingNotes, [](auto &note) { return note.is_idle(); })));
+        return block_state::Audible;
       }
 
       constexpr void play_note(note note, std::uint32_t startSamplesFromNextBlock, std::uint32_t stopAfterSamples)
       {
-        using namespace literals;
+        // The voice is only built in the block where the note starts, until then it costs nothing
+        m_pendingNotes.emplace_back(
+          note.note_frequency, m_blockStartSampleNumber + startSamplesFromNextBlock, stopAfterSamples);
+      }
 
-        m_playingNotes.emplace_back(
-          m_envelope, startSamplesFromNextBlock, stopAfterSamples, note.note_frequency, m_volume);
+      // Start a note that began `samplesSinceNoteOn` samples before the next block, for rendering
+      // from part way through a song. Notes that would already have finished are ignored.
+      constexpr void resume_note(note note, std::uint32_t samplesSinceNoteOn, std::uint32_t stopAfterSamples)
+      {
+        if constexpr (CACHING == note_caching::Memoize) {
+          auto index = m_cache.find_or_render(note.note_frequency, stopAfterSamples);
+          if (samplesSinceNoteOn < m_cache.samples(index).size()) {
+            m_cachedNotes.push_back(cached_note{ index, samplesSinceNoteOn });
+            m_stats.voices_started();
+          }
+        } else {
+          Note resumed{ m_envelope, 0, stopAfterSamples, note.note_frequency, m_volume };
+          resumed.resume(samplesSinceNoteOn, stopAfterSamples);
+          if (!resumed.is_idle()) {
+            m_playingNotes.push_back(resumed);
+            m_stats.voices_started();
+          }
+        }
+      }
+
+      // nothing playing and nothing waiting to start
+      [[nodiscard]] constexpr auto is_idle() const -> bool
+      {
+        return m_pendingNotes.empty() and m_playingNotes.empty() and m_cachedNotes.empty();
+      }
+
+      // all zero without note_caching::Memoize
+      [[nodiscard]] constexpr auto cache_stats() const -> note_cache_stats
+      {
+        if constexpr (CACHING == note_caching::Memoize) {
+          return m_cache.stats();
+        } else {
+          return {};
+        }
+      }
+
+      constexpr void attach_stats(STATS &stats)
+      {
+        m_stats.attach(stats);
       }
 
     private:
       using Note = sources::note_base<RATE, OSCILLATOR>;
+
+      struct pending_note
+      {
+        frequency noteFrequency;
+        std::uint64_t noteOn;  // absolute sample number
+        std::uint32_t length;
+      };
+
+      struct cached_note
+      {
+        std::size_t index;  // in m_cache
+        std::int64_t position;  // of the next block in the cached samples, negative before the note on
+      };
+
+      // stands in for the note_cache without note_caching::Memoize, taking no space
+      struct no_note_cache
+      {
+        constexpr no_note_cache(envelope /*env*/, volume /*vol*/) {}
+      };
+
+      using Cache = std::conditional_t<CACHING == note_caching::Memoize, note_cache<RATE, OSCILLATOR>, no_note_cache>;
+
       envelope m_envelope;
       volume m_volume;
+      std::uint64_t m_blockStartSampleNumber{ 0 };
+      std::vector<pending_note> m_pendingNotes{};
       std::vector<Note> m_playingNotes{};
+      [[no_unique_address]] Cache m_cache;
+      std::vector<cached_note> m_cachedNotes{};
+      [[no_unique_address]] detail::stats_hook<STATS> m_stats{};
+
+      // start the voices for notes that begin in the next `blockSize` samples
+      constexpr void activate_notes(std::uint32_t blockSize)
+      {
+        for (std::size_t i{ 0 }; i < m_pendingNotes.size();) {
+          auto &pending = m_pendingNotes[i];
+          if (pending.noteOn >= m_blockStartSampleNumber + blockSize) {
+            ++i;
+            continue;
+          }
+
+          auto offset = static_cast<std::uint32_t>(pending.noteOn - m_blockStartSampleNumber);
+          if constexpr (CACHING == note_caching::Memoize) {
+            auto index = m_cache.find_or_render(pending.noteFrequency, pending.length);
+            m_cachedNotes.push_back(cached_note{ index, -static_cast<std::int64_t>(offset) });
+          } else {
+            m_playingNotes.emplace_back(m_envelope, offset, pending.length, pending.noteFrequency, m_volume);
+          }
+          m_stats.voices_started();
+
+          // order does not matter, swap the last one into this slot
+          pending = m_pendingNotes.back();
+          m_pendingNotes.pop_back();
+        }
+      }
+
+      // add the part of each cached note that falls in this block, then drop the ones that have finished
+      constexpr void render_cached_notes(std::span<float> buffer, float gain)
+      {
+        auto const size = static_cast<std::int64_t>(buffer.size());
+        for (auto &playing : m_cachedNotes) {
+          auto samples = m_cache.samples(playing.index);
+          auto const begin = std::max<std::int64_t>(0, -playing.position);
+          auto const end = std::min<std::int64_t>(size, static_cast<std::int64_t>(samples.size()) - playing.position);
+          // plain pointers, span indexing is a function call per sample during constant evaluation
+          float *out = buffer.data() + begin;
+          float const *in = samples.data() + (playing.position + begin);
+          for (auto i = begin; i < end; ++i) {
+            *out++ += *in++ * gain;
+          }
+          playing.position += size;
+        }
+
+        m_stats.voices_culled(static_cast<std::uint32_t>(std::erase_if(m_cachedNotes, [this](auto const &playing) {
+          return playing.position >= static_cast<std::int64_t>(m_cache.samples(playing.index).size());
+        })));
+      }
     };
 
     template<sample_rate RATE>
@@ -65,6 +216,82 @@ namespace tmp {
         : synth_base<RATE, tmp::sources::sin_oscillator>(env, vol)
       {}
     };
+
+    template<sample_rate RATE>
+    class wavetable_synth : public synth_base<RATE, sources::wavetable_oscillator>
+    {
+    public:
+      constexpr wavetable_synth(envelope env, volume vol)
+        : synth_base<RATE, tmp::sources::wavetable_oscillator>(env, vol)
+      {}
+    };
+
+    template<sample_rate RATE>
+    class saw_synth : public synth_base<RATE, sources::saw_oscillator>
+    {
+    public:
+      constexpr saw_synth(envelope env, volume vol)
+        : synth_base<RATE, tmp::sources::saw_oscillator>(env, vol)
+      {}
+    };
+
+    template<sample_rate RATE>
+    class square_synth : public synth_base<RATE, sources::square_oscillator>
+    {
+    public:
+      constexpr square_synth(envelope env, volume vol)
+        : synth_base<RATE, tmp::sources::square_oscillator>(env, vol)
+      {}
+    };
+
+    template<sample_rate RATE>
+    class triangle_synth : public synth_base<RATE, sources::triangle_oscillator>
+    {
+    public:
+      constexpr triangle_synth(envelope env, volume vol)
+        : synth_base<RATE, tmp::sources::triangle_oscillator>(env, vol)
+      {}
+    };
+
+    template<sample_rate RATE>
+    class cached_sin_synth : public synth_base<RATE, sources::sin_oscillator, note_caching::Memoize>
+    {
+    public:
+      constexpr cached_sin_synth(envelope env, volume vol)
+        : synth_base<RATE, tmp::sources::sin_oscillator, note_caching::Memoize>(env, vol)
+      {}
+    };
+
+    template<sample_rate RATE>
+    class cached_wavetable_synth : public synth_base<RATE, sources::wavetable_oscillator, note_caching::Memoize>
+    {
+    public:
+      constexpr cached_wavetable_synth(envelope env, volume vol)
+        : synth_base<RATE, tmp::sources::wavetable_oscillator, note_caching::Memoize>(env, vol)
+      {}
+    };
+
+    //
+    // A synth_base with a statistics policy (render_stats by default). It is a class template rather than
+    // an alias so a sequencer can still deduce the instrument:
+    //
+    //   traced_synth<sources::sin_oscillator>::type<Rate> synth{ env, vol };
+    //   sequencer sequencer{ synth };  // sequencer<Rate, ..., render_stats>
+    //
+    template<template<sample_rate> typename OSCILLATOR,
+      note_caching CACHING = note_caching::None,
+      typename STATS = render_stats>
+    struct traced_synth
+    {
+      template<sample_rate RATE>
+      class type : public synth_base<RATE, OSCILLATOR, CACHING, STATS>
+      {
+      public:
+        constexpr type(envelope env, volume vol)
+          : synth_base<RATE, OSCILLATOR, CACHING, STATS>(env, vol)
+        {}
+      };
+    };
   }  // namespace instruments
 
   template<sample_rate RATE, template<sample_rate> typename... SOURCES>
@@ -78,17 +305,30 @@ namespace tmp {
     {}
 
     template<block_size BLOCK_SIZE>
-    constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+    constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+    {
+      std::ranges::fill(buffer, 0.0F);
+      return render_add<BLOCK_SIZE>(buffer);
+    }
+
+    constexpr auto render(std::span<float> buffer) -> block_state
     {
       std::ranges::fill(buffer, 0.0F);  // zero the output buffer before rendering
+      return render_add(buffer);
+    }
+
+    // sources that can accumulate add straight into the buffer, others go through a scratch buffer,
+    // BLOCK_SIZE is passed on to sources with only a fixed size render<BLOCK_SIZE>()
+    template<block_size BLOCK_SIZE = detail::AnyBlockSize>
+    constexpr auto render_add(std::span<float> buffer, float gain = 1.0F) -> block_state
+    {
+      auto result = block_state::Silent;
 
       std::apply(
-        [&buffer](auto &...sources) {
-          auto process = [&buffer](auto &src) {
-            std::array<float, BLOCK_SIZE.samplesPerBlock> sampleBuffer;
-            src.template render<BLOCK_SIZE>(sampleBuffer);
-            for (std::size_t i{ 0 }; i < BLOCK_SIZE.samplesPerBlock; ++i) {
-              buffer[i] = buffer[i] + sampleBuffer[i];
+        [&buffer, &result, gain](auto &...sources) {
+          auto process = [&buffer, &result, gain](auto &src) {
+            if (detail::render_add_span<BLOCK_SIZE>(src, buffer, gain) == block_state::Audible) {
+              result = block_state::Audible;
             }
           };
 
@@ -96,10 +336,110 @@ namespace tmp {
           (process(sources), ...);
         },
         m_sources);
+
+      return result;
+    }
+
+  private:
+    SourceTuple m_sources;
+  };
+
+  //
+  // Mixes sources into a planar stereo pair, each placed with its own pan. The pan gains are applied
+  // as a source is added to the output so panning does not cost a pass of its own. Mono sources are
+  // spread by the pan law, stereo sources have each channel scaled, acting as a balance control.
+  //
+  // Sources are held by value, a sequencer can be used directly as it refers to its instrument.
+  //
+  //   stereo_mixer mix{ std::array{ pan{ -0.5F }, pan{ 0.5F } }, bassSequencer, leadSequencer };
+  //   wav_renderer_stereo<Rate, length> wav{};
+  //   wav.render(mix);
+  //
+  template<typename... SOURCES>
+  class stereo_mixer
+  {
+  public:
+    using SourceTuple = std::tuple<SOURCES...>;
+    static constexpr std::size_t NumberSources = sizeof...(SOURCES);
+
+    constexpr stereo_mixer(std::array<pan, NumberSources> pans, SOURCES... srcs)
+      : m_sources{ srcs... }
+    {
+      for (std::size_t i{ 0 }; i < NumberSources; ++i) {
+        m_leftGain[i] = pans[i].left_gain();
+        m_rightGain[i] = pans[i].right_gain();
+      }
+    }
+
+    template<block_size BLOCK_SIZE>
+    constexpr auto render_stereo(std::span<float, BLOCK_SIZE.samplesPerBlock> left,
+      std::span<float, BLOCK_SIZE.samplesPerBlock> right) -> block_state
+    {
+      return mix<BLOCK_SIZE>(left, right);
+    }
+
+    constexpr auto render_stereo(std::span<float> left, std::span<float> right) -> block_state
+    {
+      return mix<detail::AnyBlockSize>(left, right);
     }
 
   private:
     SourceTuple m_sources;
+    std::array<float, NumberSources> m_leftGain{};
+    std::array<float, NumberSources> m_rightGain{};
+
+    // BLOCK_SIZE is passed on to sources with only a fixed size render<BLOCK_SIZE>()
+    template<block_size BLOCK_SIZE>
+    constexpr auto mix(std::span<float> left, std::span<float> right) -> block_state
+    {
+      std::ranges::fill(left, 0.0F);  // zero the output buffers before rendering
+      std::ranges::fill(right, 0.0F);
+      auto result = block_state::Silent;
+
+      std::apply(
+        [&](auto &...sources) {
+          std::size_t index{ 0 };
+          auto process = [&](auto &src) {
+            auto const leftGain = m_leftGain[index];
+            auto const rightGain = m_rightGain[index];
+            ++index;
+
+            constexpr std::size_t Scratch = detail::span_source<std::remove_cvref_t<decltype(src)>>
+                                              ? detail::ScratchSamples
+                                              : BLOCK_SIZE.samplesPerBlock;
+            std::array<float, Scratch> sampleLeft;
+            std::array<float, Scratch> sampleRight;
+            for (std::size_t offset{ 0 }; offset < left.size(); offset += sampleLeft.size()) {
+              auto count = std::min(sampleLeft.size(), left.size() - offset);
+              auto partLeft = std::span<float>{ sampleLeft }.first(count);
+              auto partRight = std::span<float>{ sampleRight }.first(count);
+
+              if constexpr (requires { src.render_stereo(partLeft, partRight); }) {
+                if (src.render_stereo(partLeft, partRight) == block_state::Silent) {
+                  continue;
+                }
+              } else {
+                if (detail::render_span<BLOCK_SIZE>(src, partLeft) == block_state::Silent) {
+                  continue;
+                }
+                partRight = partLeft;
+              }
+
+              for (std::size_t i{ 0 }; i < count; ++i) {
+                left[offset + i] += partLeft[i] * leftGain;
+                right[offset + i] += partRight[i] * rightGain;
+              }
+              result = block_state::Audible;
+            }
+          };
+
+          // fold over all sources
+          (process(sources), ...);
+        },
+        m_sources);
+
+      return result;
+    }
   };
 
 
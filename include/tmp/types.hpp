@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <cstddef>
+#include <concepts>
 #include <cstdint>
+#include <numbers>
+#include <span>
 #include <stdexcept>
 #include <string_view>
+#include <type_traits>
 
 namespace tmp {
 
@@ -100,6 +105,36 @@ namespace tmp {
     float value;
   };
 
+  // Position in the stereo field, -1.0F is hard left, 0.0F centre and 1.0F hard right.
+  // The gains follow a constant power (sin / cos) law so a source keeps the same loudness as it moves.
+  struct pan
+  {
+    constexpr static float Left = -1.0F;
+    constexpr static float Right = 1.0F;
+
+    constexpr explicit pan(float position)
+      : position{ std::clamp(position, Left, Right) }
+    {}
+
+    float position;
+
+    [[nodiscard]] constexpr auto left_gain() const -> float
+    {
+      return std::cos(angle());
+    }
+
+    [[nodiscard]] constexpr auto right_gain() const -> float
+    {
+      return std::sin(angle());
+    }
+
+  private:
+    [[nodiscard]] constexpr auto angle() const -> float
+    {
+      return (position - Left) * (std::numbers::pi_v<float> / 4.0F);
+    }
+  };
+
   struct block_size
   {
     constexpr explicit block_size(std::uint32_t samplesPerBlock)
@@ -109,6 +144,110 @@ namespace tmp {
     std::uint32_t samplesPerBlock;
   };
 
+  // Returned from render() by sources that know when a block they produced is all zeros,
+  // letting mixers and renderers skip the math for silence.
+  enum class block_state : std::uint8_t { Silent, Audible };
+
+  //
+  // Sources render into a std::span<float> of any length, `render(std::span<float>) -> block_state`
+  // (or void if they never report silence), so instruments are only instantiated once per sample rate
+  // whatever the block size. The same samples can come out in pieces of different lengths, but not
+  // always the same bits: sin_oscillator wraps its phase once per call, so the rounding differs.
+  //
+  // The library sources also keep a fixed size entry point, `render<BLOCK_SIZE>(std::span<float, N>)`,
+  // as a thin wrapper so the block length is a constant where the call is inlined. A source may have
+  // only that one, the sequencer and mixers then pass it whole blocks from their own fixed size entry
+  // points (and cannot split blocks for it, so sequencer patterns are always rendered).
+  //
+  // Oscillators, notes, synth_base and mixer also accumulate, `render_add(std::span<float>, float gain)`
+  // adds their output times gain to what is already in the span. Mixing then needs no temporary buffer
+  // per voice or per source and no second pass to sum it, render() zeroes the span and calls render_add().
+  //
+  namespace detail {
+    // Temporary buffers inside instruments and mixers hold this many samples, longer spans are
+    // rendered through them in pieces.
+    constexpr std::size_t ScratchSamples = 256;
+
+    // The BLOCK_SIZE of spans rendered through a dynamic extent render(), which may be any length
+    constexpr block_size AnyBlockSize{ 0 };
+
+    // Sources with the dynamic extent entry point
+    template<typename SOURCE>
+    concept span_source = requires(SOURCE &source, std::span<float> buffer) { source.render(buffer); };
+
+    // Render a block from any source, sources that do not report silence are always audible.
+    template<block_size BLOCK_SIZE, typename SOURCE>
+    constexpr auto render_block(SOURCE &source, std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+    {
+      if constexpr (std::is_same_v<decltype(source.template render<BLOCK_SIZE>(buffer)), block_state>) {
+        return source.template render<BLOCK_SIZE>(buffer);
+      } else {
+        source.template render<BLOCK_SIZE>(buffer);
+        return block_state::Audible;
+      }
+    }
+
+    // Render a span from any source, sources that do not report silence are always audible. A source
+    // without render(std::span<float>) is given the span as one block of BLOCK_SIZE, which is what the
+    // fixed size entry points of the sequencer and mixers pass on.
+    template<block_size BLOCK_SIZE = AnyBlockSize, typename SOURCE>
+    constexpr auto render_span(SOURCE &source, std::span<float> buffer) -> block_state
+    {
+      if constexpr (span_source<SOURCE>) {
+        if constexpr (std::is_same_v<decltype(source.render(buffer)), block_state>) {
+          return source.render(buffer);
+        } else {
+          source.render(buffer);
+          return block_state::Audible;
+        }
+      } else {
+        static_assert(
+          BLOCK_SIZE.samplesPerBlock != 0, "This source only has render<BLOCK_SIZE>(), render it in fixed size blocks");
+        if (buffer.size() != BLOCK_SIZE.samplesPerBlock) {
+          throw std::invalid_argument{ "A source with only render<BLOCK_SIZE>() must be given whole blocks" };
+        }
+        return render_block<BLOCK_SIZE>(source, buffer.first<BLOCK_SIZE.samplesPerBlock>());
+      }
+    }
+
+    // Add a span from any source into `buffer` scaled by `gain`. Sources with render_add(buffer, gain)
+    // accumulate straight into it, others are rendered through a scratch buffer (one BLOCK_SIZE block
+    // for sources with only the fixed size entry point) and added.
+    template<block_size BLOCK_SIZE = AnyBlockSize, typename SOURCE>
+    constexpr auto render_add_span(SOURCE &source, std::span<float> buffer, float gain) -> block_state
+    {
+      if constexpr (requires { source.render_add(buffer, gain); }) {
+        if constexpr (std::is_same_v<decltype(source.render_add(buffer, gain)), block_state>) {
+          return source.render_add(buffer, gain);
+        } else {
+          source.render_add(buffer, gain);
+          return block_state::Audible;
+        }
+      } else {
+        auto result = block_state::Silent;
+        std::array<float, span_source<SOURCE> ? ScratchSamples : BLOCK_SIZE.samplesPerBlock> sampleBuffer;
+        for (std::size_t offset{ 0 }; offset < buffer.size(); offset += sampleBuffer.size()) {
+          auto count = std::min(sampleBuffer.size(), buffer.size() - offset);
+          if (render_span<BLOCK_SIZE>(source, std::span<float>{ sampleBuffer }.first(count)) == block_state::Silent) {
+            continue;  // nothing to add
+          }
+          for (std::size_t i{ 0 }; i < count; ++i) {
+            buffer[offset + i] = buffer[offset + i] + (sampleBuffer[i] * gain);
+          }
+          result = block_state::Audible;
+        }
+        return result;
+      }
+    }
+
+    // Sources that produce stereo render a planar block per channel:
+    //   render_stereo<BLOCK_SIZE>(std::span<float, N> left, std::span<float, N> right) -> block_state
+    template<typename SOURCE, block_size BLOCK_SIZE>
+    concept stereo_source = requires(SOURCE &source, std::span<float, BLOCK_SIZE.samplesPerBlock> channel) {
+      { source.template render_stereo<BLOCK_SIZE>(channel, channel) } -> std::same_as<block_state>;
+    };
+  }  // namespace detail
+
   struct music
   {
     constexpr music(beats_per_minute bpm, std::string_view source)
@@ -121,6 +260,46 @@ namespace tmp {
   };
 
 
+  namespace detail {
+    // octave numbers start at C
+    inline constexpr std::array<std::string_view, 12> NoteNames{
+      "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
+    };
+
+    struct midi_note_name
+    {
+      std::array<char, 4> text;
+      std::size_t size;
+    };
+
+    // "C-1" to "G9" for every MIDI note number, so a note made from its number still has a name
+    inline constexpr auto MidiNoteNames = [] {
+      std::array<midi_note_name, 128> names{};
+      for (std::size_t n{ 0 }; n < names.size(); ++n) {
+        auto &entry = names[n];
+        for (auto c : NoteNames[n % 12]) {
+          entry.text[entry.size++] = c;
+        }
+        auto octave = static_cast<int>(n / 12) - 1;
+        if (octave < 0) {
+          entry.text[entry.size++] = '-';
+          octave = -octave;
+        }
+        entry.text[entry.size++] = static_cast<char>('0' + octave);
+      }
+      return names;
+    }();
+
+    // Equal temperament frequency of every MIDI note number, A4 (69) is 440 Hz
+    inline constexpr auto MidiNoteFrequencies = [] {
+      std::array<float, 128> frequencies{};
+      for (std::size_t n{ 0 }; n < frequencies.size(); ++n) {
+        frequencies[n] = std::pow(2.0F, (static_cast<float>(static_cast<int>(n) - 69) / 12.0F)) * 440.0F;
+      }
+      return frequencies;
+    }();
+  }  // namespace detail
+
   struct note
   {
     // In MIDI, A0 is note 21, making A4 = 69, we will use MIDI note numbers
@@ -137,11 +316,27 @@ namespace tmp {
 
     {}
 
+    // The note for a MIDI note number (0..127), with the frequency looked up rather than computed
+    constexpr static auto from_number(std::uint8_t noteNumber) -> note
+    {
+      if (noteNumber >= detail::MidiNoteNames.size()) {
+        throw std::invalid_argument{ "MIDI note number out of range (0..127)" };
+      }
+      auto const &name = detail::MidiNoteNames[noteNumber];
+      return note{ std::string_view{ name.text.data(), name.size }, noteNumber };
+    }
+
     std::string_view note_name;
     int note_number;
     frequency note_frequency;
 
   private:
+    constexpr note(std::string_view name, int noteNumber)
+      : note_name{ name }
+      , note_number{ noteNumber }
+      , note_frequency{ calculate_frequency(note_number) }
+    {}
+
     constexpr static auto parse_note_number(std::string_view note) -> int
     {
       // Name in format of <N><Octave>
@@ -149,11 +344,6 @@ namespace tmp {
       // We use the offset into music as the note number and calculate
       // the frequency from formula here: https://en.wikipedia.org/wiki/Piano_key_frequencies
 
-      // octave numbers start at C
-      constexpr static std::array<std::string_view, 12> Notes{
-        "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
-      };
-
       std::string_view name;
       std::string_view octave;
       if (note.length() == 2) {
@@ -167,11 +357,11 @@ namespace tmp {
       }
 
       // find note name in list and get its index
-      auto pos = std::find(Notes.begin(), Notes.end(), name);
-      if (pos == Notes.end()) {
+      auto pos = std::find(detail::NoteNames.begin(), detail::NoteNames.end(), name);
+      if (pos == detail::NoteNames.end()) {
         throw std::invalid_argument{ "Invalid note name, (A-G#, no B# or E#)" };
       }
-      auto noteNumber = static_cast<int>(C0NoteNumber + std::distance(Notes.begin(), pos));
+      auto noteNumber = static_cast<int>(C0NoteNumber + std::distance(detail::NoteNames.begin(), pos));
 
       // find the octave number
       if (octave[0] < '0' || octave[0] > '8') {
@@ -184,11 +374,19 @@ namespace tmp {
 
     constexpr static auto calculate_frequency(int noteNumber) -> frequency
     {
-      // compute the frequency
-      return frequency{ std::pow(2.0F, (static_cast<float>(noteNumber - A4NoteNumber) / 12.0F)) * A4NoteFrequency };
+      return frequency{ detail::MidiNoteFrequencies[static_cast<std::size_t>(noteNumber)] };
     }
   };
 
+  // A note event in sample time as produced by bake_music(), 12 bytes instead of a full note.
+  // The frequency comes from the note number when it is played.
+  struct compact_event
+  {
+    std::uint8_t noteNumber;  // MIDI note number
+    std::uint32_t noteOn;  // sample number
+    std::uint32_t length;  // samples
+  };
+
   //          /\
   //         /  \
   //        /   --- . . . ---\
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <utility>
+
+#include "types.hpp"
+
+namespace tmp {
+
+  //
+  // Runs SOURCE at 1 / FACTOR of the output sample rate and interpolates it up to the output rate, so
+  // parts with no high frequency content (bass, pads) are only synthesised for a fraction of the samples.
+  // SOURCE must be built for the lower rate, e.g. a sequencer and synth at Rate / 2:
+  //
+  //   sin_synth<LowRate> bass{ ... };
+  //   sequencer bassPart{ bass };
+  //   stereo_mixer mix{ std::array{ pan{ -0.3F }, pan{ 0.3F } }, upsampler<2, decltype(bassPart)>{ bassPart }, lead };
+  //
+  // The interpolation filter is a Blackman windowed sinc, FACTOR * TAPS long, split into FACTOR polyphase
+  // branches of TAPS coefficients that are computed at compile time. Its cutoff is the Nyquist frequency of
+  // the lower rate, content near that is attenuated and may image, keep it well below.
+  //
+  // The centre tap lands on an input sample, so one branch passes input samples straight through and each
+  // output costs TAPS multiply adds on the others. Output is delayed by Latency samples at the output rate.
+  //
+  template<std::uint32_t FACTOR, typename SOURCE, std::size_t TAPS = 8>
+  class upsampler
+  {
+    static_assert(FACTOR >= 2, "upsampling needs a factor of 2 or more");
+    static_assert(TAPS >= 2 and (FACTOR * TAPS) % 2 == 0, "FACTOR * TAPS must be even to centre the filter");
+
+    static constexpr std::size_t Length = (FACTOR * TAPS) - 1;  // odd, the last slot of the table is zero
+    static constexpr std::size_t Centre = (Length - 1) / 2;
+    static constexpr std::uint32_t PassPhase = Centre % FACTOR;
+    static constexpr std::size_t PassDelay = Centre / FACTOR;
+
+    // Coefficients[phase][k] scales the input k samples back for an output at that phase
+    static constexpr auto design() -> std::array<std::array<float, TAPS>, FACTOR>
+    {
+      constexpr double Pi = std::numbers::pi;
+      std::array<std::array<double, TAPS>, FACTOR> h{};
+      for (std::size_t j{ 0 }; j < Length; ++j) {
+        auto const offset = static_cast<double>(j) - static_cast<double>(Centre);
+        double sinc{ 1.0 };
+        if ((j + FACTOR - PassPhase) % FACTOR == 0) {
+          sinc = j == Centre ? 1.0 : 0.0;  // exact zero crossings, so the pass through branch is exact
+        } else {
+          auto const x = offset / FACTOR;
+          sinc = std::sin(Pi * x) / (Pi * x);
+        }
+        auto const t = 2.0 * Pi * static_cast<double>(j) / static_cast<double>(Length - 1);
+        auto const window = 0.42 - (0.5 * std::cos(t)) + (0.08 * std::cos(2.0 * t));
+        h[j % FACTOR][j / FACTOR] = sinc * window;
+      }
+
+      // each branch has unity gain at DC so there is no ripple on a constant input
+      std::array<std::array<float, TAPS>, FACTOR> coefficients{};
+      for (std::size_t p{ 0 }; p < FACTOR; ++p) {
+        double sum{ 0.0 };
+        for (auto c : h[p]) {
+          sum += c;
+        }
+        for (std::size_t k{ 0 }; k < TAPS; ++k) {
+          coefficients[p][k] = static_cast<float>(h[p][k] / sum);
+        }
+      }
+      return coefficients;
+    }
+
+    static constexpr auto Coefficients = design();
+
+  public:
+    static constexpr std::size_t Latency = Centre;  // output samples
+
+    constexpr explicit upsampler(SOURCE source)
+      : m_source{ source }
+    {}
+
+    template<block_size BLOCK_SIZE>
+    constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+    {
+      return render(std::span<float>{ buffer });
+    }
+
+    constexpr auto render(std::span<float> buffer) -> block_state
+    {
+      std::ranges::fill(buffer, 0.0F);
+      return render_add(buffer);
+    }
+
+    constexpr auto render_add(std::span<float> buffer, float gain = 1.0F) -> block_state
+    {
+      auto result = block_state::Silent;
+      std::size_t done{ 0 };
+      while (done < buffer.size()) {
+        // outputs on phase 0 take a new input sample, render as many as fit in the scratch space
+        auto const remaining = buffer.size() - done;
+        auto const first = (FACTOR - m_phase) % FACTOR;  // outputs before the next new input
+        auto const needed = remaining > first ? (remaining - first + FACTOR - 1) / FACTOR : 0;
+        auto const inputs = std::min(needed, detail::ScratchSamples);
+        auto const outputs = needed > inputs ? first + (inputs * FACTOR) : remaining;
+
+        auto newInput = std::span<float>{ m_input }.subspan(TAPS, inputs);
+        if (inputs > 0 and detail::render_span(m_source, newInput) == block_state::Audible) {
+          m_silentInputs = 0;
+        } else {
+          m_silentInputs += inputs;
+        }
+
+        if (m_silentInputs >= TAPS + inputs) {
+          // every input in reach of the filter is zero
+          m_phase = static_cast<std::uint32_t>((m_phase + outputs) % FACTOR);
+        } else {
+          interpolate(buffer.data() + done, outputs, gain);
+          result = block_state::Audible;
+        }
+
+        // keep the last TAPS inputs as the history for the next part
+        std::copy_n(m_input.begin() + static_cast<std::ptrdiff_t>(inputs), TAPS, m_input.begin());
+        done += outputs;
+      }
+      return result;
+    }
+
+  private:
+    SOURCE m_source;
+    std::uint32_t m_phase{ 0 };  // of the next output, 0 takes a new input sample
+    std::size_t m_silentInputs{ TAPS };  // trailing zero inputs
+    // m_input[TAPS - 1] is the latest input used so far, new input is rendered after it
+    std::array<float, TAPS + detail::ScratchSamples> m_input{};
+
+    // Plain pointers, the taps unrolled and the phase loop nested in the input loop. During constant
+    // evaluation every index, comparison and increment is interpreted and costs more than the math.
+    constexpr void interpolate(float *out, std::size_t outputs, float gain)
+    {
+      float const *latest = m_input.data() + (TAPS - 1);
+      float *const end = out + outputs;
+      auto phase = m_phase;
+      while (out != end) {
+        if (phase == 0) {
+          ++latest;
+        }
+        for (; phase < FACTOR and out != end; ++phase, ++out) {
+          if (phase == PassPhase) {
+            *out += *(latest - PassDelay) * gain;
+          } else {
+            *out += dot(latest, Coefficients[phase].data(), std::make_index_sequence<TAPS>{}) * gain;
+          }
+        }
+        if (phase == FACTOR) {
+          phase = 0;
+        }
+      }
+      m_phase = phase;
+    }
+
+    template<std::size_t... K>
+    static constexpr auto dot(float const *latest, float const *coefficient, std::index_sequence<K...>) -> float
+    {
+      return ((*(latest - K) * coefficient[K]) + ...);
+    }
+  };
+
+  //
+  // Adapts a `template<sample_rate>` source to run at 1 / FACTOR of the mixer's rate, for mixer:
+  //
+  //   mixer<Rate, wavetable_synth, at_lower_rate<2, wavetable_synth>::source> mix{ lead, upsampledBass };
+  //
+  template<std::uint32_t FACTOR, template<sample_rate> typename SOURCE, std::size_t TAPS = 8>
+  struct at_lower_rate
+  {
+    template<sample_rate RATE>
+    struct lower_rate
+    {
+      static_assert(RATE.samples_per_second % FACTOR == 0, "the mixer's rate must be a multiple of FACTOR");
+      static constexpr sample_rate Rate{ RATE.samples_per_second / FACTOR };
+    };
+
+    template<sample_rate RATE>
+    using source = upsampler<FACTOR, SOURCE<lower_rate<RATE>::Rate>, TAPS>;
+  };
+
+}  // namespace tmp
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+#include "sources.hpp"
+#include "types.hpp"
+
+namespace tmp::instruments {
+
+  // What a full voice_bank does with a new note
+  enum class voice_steal_policy : std::uint8_t {
+    Oldest,  // replace the voice that was started first
+    Quietest,  // replace the voice with the lowest envelope level
+    None  // drop the new note
+  };
+
+  //
+  // Fixed capacity polyphonic synth. This plays the same role as synth_base but keeps all voice
+  // state in parallel arrays (structure of arrays) instead of a vector of note objects, so there
+  // is no allocation, no per-note temporary buffer and no erase_if() per block.
+  //
+  // The OSCILLATOR must provide a stateless `static constexpr auto wave(std::uint32_t phase) -> float`
+  // where the phase is a 32 bit fixed point fraction of a cycle, the bank owns the phase accumulators.
+  //
+  // Envelope segments are counted in samples (see envelope_generator), a block is split into runs where no voice changes
+  // segment, and each run is plain arithmetic with no branching. At run time voices are processed
+  // in groups of Lanes so the compiler can vectorise across voices, during constant evaluation a
+  // scalar voice by voice loop is used which skips voices that are still waiting to start.
+  //
+  template<sample_rate RATE,
+    template<sample_rate>
+    typename OSCILLATOR,
+    std::size_t VOICES = 32,
+    voice_steal_policy POLICY = voice_steal_policy::Oldest>
+  class voice_bank
+  {
+    static_assert(VOICES > 0, "voice_bank needs at least one voice");
+
+    static constexpr std::size_t Lanes = 8;
+    static constexpr std::size_t Capacity = ((VOICES + Lanes - 1) / Lanes) * Lanes;
+
+  public:
+    constexpr voice_bank(envelope env, volume vol)
+      : m_segments{ env }
+      , m_volume{ vol }
+    {}
+
+    [[nodiscard]] constexpr auto active_voices() const -> std::size_t
+    {
+      return m_active;
+    }
+
+    [[nodiscard]] constexpr auto is_idle() const -> bool
+    {
+      return m_active == 0;
+    }
+
+    constexpr void play_note(note note, std::uint32_t startSamplesFromNextBlock, std::uint32_t stopAfterSamples)
+    {
+      start_voice(note, startSamplesFromNextBlock, stopAfterSamples);
+    }
+
+    // Start a note that began `samplesSinceNoteOn` samples before the next block, for rendering
+    // from part way through a song. Notes that would already have finished are ignored.
+    constexpr void resume_note(note note, std::uint32_t samplesSinceNoteOn, std::uint32_t stopAfterSamples)
+    {
+      auto v = start_voice(note, 0, stopAfterSamples);
+      if (v == NoVoice) {
+        return;
+      }
+
+      // walk the segments as render() would, without producing samples
+      std::uint64_t samples = samplesSinceNoteOn;
+      while (samples > 0) {
+        auto run = static_cast<std::uint32_t>(std::min<std::uint64_t>(m_remaining[v], samples));
+        if (m_state[v] != State::Wait) {
+          m_level[v] += m_step[v] * static_cast<float>(run);
+          m_phase[v] += m_increment[v] * run;
+          m_untilOff[v] -= m_state[v] == State::Release ? 0 : run;
+        }
+        m_remaining[v] -= run;
+        samples -= run;
+        if (m_remaining[v] == 0 and !advance(v)) {
+          return;
+        }
+      }
+    }
+
+    template<block_size BLOCK_SIZE>
+    constexpr auto render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer) -> block_state
+    {
+      return render(std::span<float>{ buffer });
+    }
+
+    constexpr auto render(std::span<float> buffer) -> block_state
+    {
+      std::ranges::fill(buffer, 0.0F);  // zero the output buffer before rendering
+      auto result = block_state::Silent;
+
+      auto const size = static_cast<std::uint32_t>(buffer.size());
+      std::uint32_t offset{ 0 };
+      while (offset < size) {
+        // longest run where no voice changes envelope segment
+        std::uint32_t run = size - offset;
+        bool sounding{ false };
+        for (std::size_t v{ 0 }; v < m_active; ++v) {
+          run = std::min(run, m_remaining[v]);
+          sounding = sounding or m_state[v] != State::Wait;
+        }
+
+        // voices waiting for their note on cost nothing
+        if (sounding) {
+          result = block_state::Audible;
+          if consteval {
+            render_run_scalar(buffer.data() + offset, run);
+          } else {
+            render_run_lanes(buffer.data() + offset, run);
+          }
+        }
+
+        for (std::size_t v{ 0 }; v < m_active;) {
+          m_remaining[v] -= run;
+          if (m_state[v] != State::Wait and m_state[v] != State::Release) {
+            m_untilOff[v] -= run;
+          }
+          if (m_remaining[v] == 0 and !advance(v)) {
+            continue;  // voice finished, v now holds the voice moved from the end
+          }
+          ++v;
+        }
+
+        offset += run;
+      }
+
+      return result;
+    }
+
+  private:
+    using State = sources::detail::envelope_state;
+
+    static constexpr std::size_t NoVoice = Capacity;
+
+    sources::detail::envelope_segments<RATE> m_segments;
+    volume m_volume;
+
+    std::size_t m_active{ 0 };
+    std::uint32_t m_nextAge{ 0 };
+
+    // per voice state, only [0, m_active) are in use. Slots above that are kept at zero
+    // level and step so whole lane groups can be processed without masking.
+    std::array<std::uint32_t, Capacity> m_phase{};
+    std::array<std::uint32_t, Capacity> m_increment{};
+    std::array<float, Capacity> m_level{};
+    std::array<float, Capacity> m_step{};
+    std::array<std::uint32_t, Capacity> m_remaining{};  // samples until the next segment change
+    std::array<std::uint32_t, Capacity> m_untilOff{};  // samples until note off, counted from attack
+    std::array<std::uint32_t, Capacity> m_age{};
+    std::array<State, Capacity> m_state{};
+
+    // claim a voice for the note, returns NoVoice if the bank is full and the policy drops it
+    constexpr auto start_voice(note note, std::uint32_t startSamplesFromNextBlock, std::uint32_t stopAfterSamples)
+      -> std::size_t
+    {
+      std::size_t voice = m_active;
+      if (m_active == VOICES) {
+        if constexpr (POLICY == voice_steal_policy::None) {
+          return NoVoice;
+        } else {
+          voice = find_victim();
+        }
+      } else {
+        ++m_active;
+      }
+
+      m_phase[voice] = 0;
+      m_increment[voice] = sources::detail::phase_increment(note.note_frequency, RATE);
+      m_level[voice] = 0.0F;
+      m_step[voice] = 0.0F;
+      // the note on sample itself is silent, the attack starts on the sample after (as envelope_generator)
+      m_remaining[voice] = startSamplesFromNextBlock + 1;
+      m_untilOff[voice] = stopAfterSamples + 1;
+      m_age[voice] = m_nextAge++;
+      m_state[voice] = State::Wait;
+      return voice;
+    }
+
+    constexpr void render_run_scalar(float *out, std::uint32_t count)
+    {
+      float const gain = m_volume.value;
+      for (std::size_t v{ 0 }; v < m_active; ++v) {
+        if (m_state[v] == State::Wait) {
+          continue;  // silent and the phase does not start until the attack
+        }
+
+        float level = m_level[v];
+        float const step = m_step[v];
+        std::uint32_t phase = m_phase[v];
+        std::uint32_t const increment = m_increment[v];
+        for (std::uint32_t i{ 0 }; i < count; ++i) {
+          level += step;
+          out[i] += gain * level * OSCILLATOR<RATE>::wave(phase);
+          phase += increment;
+        }
+        m_level[v] = level;
+        m_phase[v] = phase;
+      }
+    }
+
+    constexpr void render_run_lanes(float *out, std::uint32_t count)
+    {
+      float const gain = m_volume.value;
+      for (std::size_t group{ 0 }; group < m_active; group += Lanes) {
+        // copy the group to locals so the compiler knows nothing aliases the output
+        std::array<float, Lanes> level;
+        std::array<float, Lanes> step;
+        std::array<std::uint32_t, Lanes> phase;
+        std::array<std::uint32_t, Lanes> increment;
+        for (std::size_t lane{ 0 }; lane < Lanes; ++lane) {
+          // waiting voices have a zero level and step so only need their phase held
+          bool const waiting = m_state[group + lane] == State::Wait;
+          level[lane] = m_level[group + lane];
+          step[lane] = m_step[group + lane];
+          phase[lane] = m_phase[group + lane];
+          increment[lane] = waiting ? 0 : m_increment[group + lane];
+        }
+
+        for (std::uint32_t i{ 0 }; i < count; ++i) {
+          float acc{ 0.0F };
+          for (std::size_t lane{ 0 }; lane < Lanes; ++lane) {
+            level[lane] += step[lane];
+            acc += level[lane] * OSCILLATOR<RATE>::wave(phase[lane]);
+            phase[lane] += increment[lane];
+          }
+          out[i] += gain * acc;
+        }
+
+        for (std::size_t lane{ 0 }; lane < Lanes; ++lane) {
+          m_level[group + lane] = level[lane];
+          m_phase[group + lane] = phase[lane];
+        }
+      }
+    }
+
+    // move voice v to its next envelope segment, returns false if the voice finished and was removed
+    constexpr auto advance(std::size_t v) -> bool
+    {
+      // zero length segments are skipped straight over
+      while (m_remaining[v] == 0) {
+        auto next = m_segments.next(m_state[v], m_level[v], m_untilOff[v]);
+        if (next.state == State::Idle) {
+          remove(v);
+          return false;
+        }
+        if (next.state == State::Attack) {
+          m_phase[v] = m_increment[v];  // phase is zero on the (silent) note on sample, as note_base
+        }
+        m_state[v] = next.state;
+        m_level[v] = next.level;
+        m_step[v] = next.step;
+        m_remaining[v] = next.samples;
+      }
+      return true;
+    }
+
+    constexpr void remove(std::size_t v)
+    {
+      auto last = --m_active;
+      m_phase[v] = m_phase[last];
+      m_increment[v] = m_increment[last];
+      m_level[v] = m_level[last];
+      m_step[v] = m_step[last];
+      m_remaining[v] = m_remaining[last];
+      m_untilOff[v] = m_untilOff[last];
+      m_age[v] = m_age[last];
+      m_state[v] = m_state[last];
+
+      // keep unused slots silent
+      m_increment[last] = 0;
+      m_level[last] = 0.0F;
+      m_step[last] = 0.0F;
+    }
+
+    [[nodiscard]] constexpr auto find_victim() const -> std::size_t
+    {
+      std::size_t victim{ 0 };
+      if constexpr (POLICY == voice_steal_policy::Oldest) {
+        for (std::size_t v{ 1 }; v < m_active; ++v) {
+          // ages are unsigned so the comparison survives the counter wrapping
+          if (m_nextAge - m_age[v] > m_nextAge - m_age[victim]) {
+            victim = v;
+          }
+        }
+      } else {
+        // notes still waiting to start are treated as loud, they have not been heard yet
+        auto loudness = [this](std::size_t v) {
+          return m_state[v] == State::Wait ? std::numeric_limits<float>::max() : m_level[v];
+        };
+        for (std::size_t v{ 1 }; v < m_active; ++v) {
+          if (loudness(v) < loudness(victim)) {
+            victim = v;
+          }
+        }
+      }
+      return victim;
+    }
+  };
+
+
+  //
+  // voice_bank instruments with the default capacity and policy. Like sin_synth these are
+  // classes so they fit the `template<sample_rate> typename` parameters of sequencer and mixer,
+  // derive your own the same way to change the capacity or policy.
+  //
+  template<sample_rate RATE>
+  class sin_bank_synth : public voice_bank<RATE, sources::sin_oscillator>
+  {
+  public:
+    constexpr sin_bank_synth(envelope env, volume vol)
+      : voice_bank<RATE, sources::sin_oscillator>(env, vol)
+    {}
+  };
+
+  template<sample_rate RATE>
+  class wavetable_bank_synth : public voice_bank<RATE, sources::wavetable_oscillator>
+  {
+  public:
+    constexpr wavetable_bank_synth(envelope env, volume vol)
+      : voice_bank<RATE, sources::wavetable_oscillator>(env, vol)
+    {}
+  };
+
+}  // namespace tmp::instruments
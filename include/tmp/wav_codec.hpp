@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace tmp {
+
+  // Sample format of the data chunk written by wav_renderer
+  enum class wav_encoding : std::uint8_t {
+    Pcm16,  // 16 bit linear PCM
+    ImaAdpcm,  // IMA (DVI) ADPCM, 4 bits per sample in blocks that restart the predictor, 4:1
+    MuLaw,  // G.711 mu-law, 8 bits per sample, 2:1
+    ALaw  // G.711 A-law, 8 bits per sample, 2:1
+  };
+
+  namespace detail {
+    constexpr auto load_pcm16(std::byte const *in) -> std::int16_t
+    {
+      return static_cast<std::int16_t>(static_cast<std::uint16_t>(in[0]) | (static_cast<std::uint16_t>(in[1]) << 8U));
+    }
+
+    //
+    // G.711 companding as in the widely used Sun reference code. Encoding is a handful of integer
+    // operations per sample, decoding is a 256 entry table computed at compile time.
+    //
+    constexpr auto encode_mu_law(std::int16_t pcm) -> std::uint8_t
+    {
+      std::int32_t sample = pcm >> 2;  // 14 bit
+      std::uint32_t mask{ 0xFF };
+      if (sample < 0) {
+        mask = 0x7F;
+        sample = -sample;
+      }
+      sample = std::min(sample, 8159) + 33;  // clip, then add the bias
+
+      // the segment is how far the top bit is above the 6 bit first segment
+      auto const width = static_cast<std::uint32_t>(std::bit_width(static_cast<std::uint32_t>(sample)));
+      auto const segment = width > 6 ? width - 6 : 0U;
+      if (segment == 8) {
+        return static_cast<std::uint8_t>(0x7FU ^ mask);
+      }
+      auto const mantissa = static_cast<std::uint32_t>(sample >> (segment + 1)) & 0x0FU;
+      return static_cast<std::uint8_t>(((segment << 4U) | mantissa) ^ mask);
+    }
+
+    constexpr auto expand_mu_law(std::uint8_t code) -> std::int16_t
+    {
+      constexpr std::int32_t Bias = 0x84;
+
+      code = static_cast<std::uint8_t>(~code);
+      auto const exponent = (code >> 4U) & 0x07U;
+      auto const mantissa = static_cast<std::int32_t>(code & 0x0FU);
+      std::int32_t const sample = (((mantissa << 3) + Bias) << exponent) - Bias;
+      return static_cast<std::int16_t>((code & 0x80U) != 0 ? -sample : sample);
+    }
+
+    constexpr auto encode_a_law(std::int16_t pcm) -> std::uint8_t
+    {
+      std::int32_t sample = pcm >> 3;  // 13 bit
+      std::uint32_t mask{ 0xD5 };
+      if (sample < 0) {
+        mask = 0x55;
+        sample = -sample - 1;
+      }
+
+      auto const width = static_cast<std::uint32_t>(std::bit_width(static_cast<std::uint32_t>(sample)));
+      auto const segment = width > 5 ? width - 5 : 0U;
+      if (segment == 8) {
+        return static_cast<std::uint8_t>(0x7FU ^ mask);
+      }
+      auto const mantissa = static_cast<std::uint32_t>(sample >> (segment < 2 ? 1 : segment)) & 0x0FU;
+      return static_cast<std::uint8_t>(((segment << 4U) | mantissa) ^ mask);
+    }
+
+    constexpr auto expand_a_law(std::uint8_t code) -> std::int16_t
+    {
+      code ^= 0x55U;
+      std::int32_t sample = static_cast<std::int32_t>(code & 0x0FU) << 4;
+      auto const segment = (code & 0x70U) >> 4U;
+      if (segment == 0) {
+        sample += 8;
+      } else {
+        sample = (sample + 0x108) << (segment - 1);
+      }
+      return static_cast<std::int16_t>((code & 0x80U) != 0 ? sample : -sample);
+    }
+
+    template<wav_encoding ENCODING>
+    constexpr std::array<std::int16_t, 256> G711Table = [] {
+      static_assert(ENCODING == wav_encoding::MuLaw or ENCODING == wav_encoding::ALaw);
+      std::array<std::int16_t, 256> table{};
+      for (std::size_t i{ 0 }; i < table.size(); ++i) {
+        auto const code = static_cast<std::uint8_t>(i);
+        table[i] = ENCODING == wav_encoding::MuLaw ? expand_mu_law(code) : expand_a_law(code);
+      }
+      return table;
+    }();
+
+    //
+    // IMA ADPCM, one channel's predictor and step index. The encoder picks the nibble whose step best
+    // matches the difference to the prediction and then updates its state exactly as the decoder will,
+    // so the two never drift apart.
+    //
+    class ima_adpcm_channel
+    {
+    public:
+      static constexpr std::array<std::int16_t, 89> StepTable{ 7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28,
+        31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+        337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+        12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 };
+      static constexpr std::array<std::int8_t, 16> IndexTable{ -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+      constexpr ima_adpcm_channel() = default;
+
+      constexpr ima_adpcm_channel(std::int16_t predictor, std::uint8_t index)
+        : m_predictor{ predictor }
+        , m_index{ std::min<std::int32_t>(index, StepTable.size() - 1) }
+      {}
+
+      [[nodiscard]] constexpr auto predictor() const -> std::int16_t
+      {
+        return static_cast<std::int16_t>(m_predictor);
+      }
+
+      [[nodiscard]] constexpr auto index() const -> std::uint8_t
+      {
+        return static_cast<std::uint8_t>(m_index);
+      }
+
+      // the start of a block stores the sample itself, the step index carries on
+      constexpr void restart(std::int16_t sample)
+      {
+        m_predictor = sample;
+      }
+
+      // the reference encoder, which builds up the decoder's reconstructed difference as it picks the bits
+      constexpr auto encode(std::int16_t sample) -> std::uint8_t
+      {
+        std::int32_t step = StepTable.data()[m_index];
+        std::int32_t difference = sample - m_predictor;
+        std::uint8_t nibble{ 0 };
+        if (difference < 0) {
+          nibble = 8;
+          difference = -difference;
+        }
+        std::int32_t reconstructed = step >> 3;
+        if (difference >= step) {
+          nibble |= 4U;
+          difference -= step;
+          reconstructed += step;
+        }
+        step >>= 1;
+        if (difference >= step) {
+          nibble |= 2U;
+          difference -= step;
+          reconstructed += step;
+        }
+        step >>= 1;
+        if (difference >= step) {
+          nibble |= 1U;
+          reconstructed += step;
+        }
+        update(nibble, reconstructed);
+        return nibble;
+      }
+
+      constexpr auto decode(std::uint8_t nibble) -> std::int16_t
+      {
+        std::int32_t const step = StepTable.data()[m_index];
+        std::int32_t reconstructed = step >> 3;
+        if ((nibble & 4U) != 0) {
+          reconstructed += step;
+        }
+        if ((nibble & 2U) != 0) {
+          reconstructed += step >> 1;
+        }
+        if ((nibble & 1U) != 0) {
+          reconstructed += step >> 2;
+        }
+        update(nibble, reconstructed);
+        return static_cast<std::int16_t>(m_predictor);
+      }
+
+    private:
+      std::int32_t m_predictor{ 0 };
+      std::int32_t m_index{ 0 };
+
+      // plain comparisons and table pointers rather than std::clamp and operator[], they are much cheaper
+      // during constant evaluation
+      constexpr void update(std::uint8_t nibble, std::int32_t reconstructed)
+      {
+        m_predictor += (nibble & 8U) != 0 ? -reconstructed : reconstructed;
+        if (m_predictor > 32767) {
+          m_predictor = 32767;
+        } else if (m_predictor < -32768) {
+          m_predictor = -32768;
+        }
+        m_index += IndexTable.data()[nibble & 0x0FU];
+        if (m_index < 0) {
+          m_index = 0;
+        } else if (m_index > static_cast<std::int32_t>(StepTable.size() - 1)) {
+          m_index = StepTable.size() - 1;
+        }
+      }
+    };
+
+    //
+    // Byte offset of a sample's nibble within a WAV IMA ADPCM block. A block starts with a 4 byte
+    // header per channel (first sample, step index, reserved), then the channels take turns with 4
+    // bytes (8 samples) each, low nibble first.
+    //
+    template<std::uint16_t CHANNELS>
+    constexpr auto ima_adpcm_nibble_offset(std::size_t sampleInBlock, std::size_t channel) -> std::size_t
+    {
+      auto const k = sampleInBlock - 1;  // the first sample is in the header
+      return (4U * CHANNELS) + ((k / 8) * 4U * CHANNELS) + (channel * 4U) + ((k % 8) / 2);
+    }
+
+    //
+    // Compresses interleaved 16 bit PCM into the data chunk of a compressed WAV. It is fed one render
+    // block at a time, finish() pads the last ADPCM block with silence.
+    //
+    template<wav_encoding ENCODING, std::uint16_t CHANNELS, std::size_t SAMPLES_PER_BLOCK, std::size_t BLOCK_ALIGN>
+    class wav_block_encoder
+    {
+    public:
+      constexpr explicit wav_block_encoder(std::span<std::byte> data)
+        : m_data{ data }
+      {}
+
+      constexpr void encode(std::span<std::int16_t const> pcm)
+      {
+        auto const *in = pcm.data();
+        auto const frames = pcm.size() / CHANNELS;
+
+        if constexpr (ENCODING == wav_encoding::ImaAdpcm) {
+          auto *channels = m_channels.data();
+          for (std::size_t i{ 0 }; i < frames; ++i, in += CHANNELS) {
+            auto *block = m_data.data() + m_block;
+            if (m_sampleInBlock == 0) {
+              for (std::size_t c{ 0 }; c < CHANNELS; ++c) {
+                start_block(block + (c * 4), channels[c], in[c]);
+              }
+            } else {
+              // nibbles are written in order, the low one first
+              auto *out = block + ima_adpcm_nibble_offset<CHANNELS>(m_sampleInBlock, 0);
+              bool const low = (m_sampleInBlock - 1) % 2 == 0;
+              for (std::size_t c{ 0 }; c < CHANNELS; ++c) {
+                auto const nibble = channels[c].encode(in[c]);
+                out[c * 4] = low ? static_cast<std::byte>(nibble) : out[c * 4] | static_cast<std::byte>(nibble << 4U);
+              }
+            }
+            if (++m_sampleInBlock == SAMPLES_PER_BLOCK) {
+              m_sampleInBlock = 0;
+              m_block += BLOCK_ALIGN;
+            }
+          }
+        } else {
+          auto *out = m_data.data() + m_block;
+          for (std::size_t i{ 0 }; i < frames * CHANNELS; ++i) {
+            out[i] =
+              static_cast<std::byte>(ENCODING == wav_encoding::MuLaw ? encode_mu_law(in[i]) : encode_a_law(in[i]));
+          }
+          m_block += frames * CHANNELS;
+        }
+      }
+
+      constexpr void finish()
+      {
+        if constexpr (ENCODING == wav_encoding::ImaAdpcm) {
+          std::array<std::int16_t, CHANNELS> silence{};
+          while (m_sampleInBlock != 0) {
+            encode(silence);
+          }
+        }
+      }
+
+    private:
+      std::span<std::byte> m_data;
+      std::size_t m_block{ 0 };  // byte offset of the current ADPCM block, or of the next G.711 sample
+      std::size_t m_sampleInBlock{ 0 };
+      std::array<ima_adpcm_channel, CHANNELS> m_channels{};
+
+      // the block header holds the first sample as is and the step index the rest of the block starts from
+      static constexpr void start_block(std::byte *header, ima_adpcm_channel &state, std::int16_t sample)
+      {
+        state.restart(sample);
+        auto const predictor = static_cast<std::uint16_t>(sample);
+        header[0] = static_cast<std::byte>(predictor & 0xFFU);
+        header[1] = static_cast<std::byte>(predictor >> 8U);
+        header[2] = static_cast<std::byte>(state.index());
+        header[3] = std::byte{ 0 };
+      }
+    };
+  }  // namespace detail
+
+  //
+  // Decoders for playing a compressed .wavefile section at run time. They write interleaved 16 bit
+  // samples to a buffer supplied by the caller and keep no state between calls, so there is nothing
+  // to allocate and any block can be decoded on its own.
+  //
+
+  // One WAV IMA ADPCM block of `BlockAlign` bytes (see wav_renderer), returns the frames decoded.
+  // `out` needs room for SamplesPerBlock frames, a short final block decodes fewer.
+  template<std::uint16_t CHANNELS = 1>
+  constexpr auto decode_ima_adpcm_block(std::span<std::byte const> block, std::span<std::int16_t> out) -> std::size_t
+  {
+    constexpr std::size_t HeaderSize = 4U * CHANNELS;
+    if (block.size() < HeaderSize or out.size() < CHANNELS) {
+      return 0;
+    }
+    auto const frames = std::min(1 + ((block.size() - HeaderSize) * 2 / CHANNELS), out.size() / CHANNELS);
+
+    auto const *in = block.data();
+    for (std::size_t c{ 0 }; c < CHANNELS; ++c) {
+      detail::ima_adpcm_channel state{ detail::load_pcm16(in + (c * 4)), static_cast<std::uint8_t>(in[(c * 4) + 2]) };
+      auto *pcm = out.data() + c;
+      *pcm = state.predictor();
+      pcm += CHANNELS;
+
+      // this channel's 4 bytes in each group of 8 samples, low nibble first
+      auto const *group = in + HeaderSize + (c * 4);
+      for (std::size_t decoded{ 1 }; decoded < frames; decoded += 8, group += 4U * CHANNELS) {
+        auto const count = std::min<std::size_t>(8, frames - decoded);
+        for (std::size_t i{ 0 }; i < count; ++i, pcm += CHANNELS) {
+          auto const byte = static_cast<std::uint8_t>(group[i / 2]);
+          *pcm = state.decode(i % 2 == 0 ? byte & 0x0FU : byte >> 4U);
+        }
+      }
+    }
+    return frames;
+  }
+
+  // G.711 (MuLaw or ALaw) bytes to samples, returns the samples decoded
+  template<wav_encoding ENCODING>
+  constexpr auto decode_g711(std::span<std::byte const> in, std::span<std::int16_t> out) -> std::size_t
+  {
+    auto const count = std::min(in.size(), out.size());
+    auto const &table = detail::G711Table<ENCODING>;
+    for (std::size_t i{ 0 }; i < count; ++i) {
+      out[i] = table[static_cast<std::uint8_t>(in[i])];
+    }
+    return count;
+  }
+
+}  // namespace tmp
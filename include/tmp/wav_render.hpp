@@ -5,10 +5,15 @@
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <numbers>
 #include <span>
+#include <utility>
 
+#include "pcm_encode.hpp"
+#include "render_stats.hpp"
 #include "types.hpp"
+#include "wav_codec.hpp"
 
 namespace tmp {
 
@@ -41,43 +46,87 @@ namespace tmp {
       buffer[0] = static_cast<std::byte>(static_cast<std::uint32_t>(data >> 24U) & 0xFFU);
     }
 
-    template<sample_rate RATE>
+    template<sample_rate RATE, std::uint16_t CHANNELS = 1, wav_encoding ENCODING = wav_encoding::Pcm16>
     struct wav_fmt_chunk
     {
-      constexpr static std::uint32_t Size = 16 + 4 + 4;
-      constexpr static std::uint8_t BytesPerSample = 2;  // forcing 16 bit
+      static_assert(CHANNELS == 1 or CHANNELS == 2, "Only mono and stereo are supported");
+
+      constexpr static bool Compressed = ENCODING != wav_encoding::Pcm16;
+      constexpr static bool Adpcm = ENCODING == wav_encoding::ImaAdpcm;
 
       constexpr static std::uint32_t SubChunkId = 0x666d7420;  // "fmt ", big endian
-      constexpr static std::uint32_t SubChunkSize = 16;  // bytes after this entry
-      constexpr static std::uint16_t AudioFormat = 0x0001;  // PCM
-      constexpr static std::uint16_t NumberChannels = 0x0001;  // 1 channel / mono
+      // bytes after this entry, compressed formats add the extension size and ADPCM its samples per block
+      constexpr static std::uint32_t SubChunkSize = Adpcm ? 20 : (Compressed ? 18 : 16);
+      constexpr static std::uint32_t Size = SubChunkSize + 4 + 4;
+      constexpr static std::uint16_t AudioFormat = [] -> std::uint16_t {
+        switch (ENCODING) {
+        case wav_encoding::ImaAdpcm:
+          return 0x0011;
+        case wav_encoding::MuLaw:
+          return 0x0007;
+        case wav_encoding::ALaw:
+          return 0x0006;
+        default:
+          return 0x0001;  // PCM
+        }
+      }();
+      constexpr static std::uint16_t NumberChannels = CHANNELS;  // 1 mono, 2 stereo (interleaved L R)
       constexpr static std::uint32_t SampleRate = RATE.samples_per_second;
-      constexpr static std::uint32_t ByteRate = SampleRate * NumberChannels * BytesPerSample;
-      constexpr static std::uint16_t BlockAlign = NumberChannels * BytesPerSample;
-      constexpr static std::uint16_t BitsPerSample = BytesPerSample * 8;  // 16 bit PCM
+      constexpr static std::uint16_t BitsPerSample = Adpcm ? 4 : (Compressed ? 8 : 16);
+      // ADPCM blocks are sized as other encoders do, 256 bytes per channel at 11 kHz and below up to 1024
+      constexpr static std::uint16_t AdpcmChannelBlock =
+        SampleRate <= 11'025 ? 256 : (SampleRate <= 22'050 ? 512 : 1024);
+      constexpr static std::uint16_t BlockAlign = NumberChannels * (Adpcm ? AdpcmChannelBlock : BitsPerSample / 8);
+      // frames in each BlockAlign bytes, the first sample of an ADPCM block is stored whole in its header
+      constexpr static std::uint16_t SamplesPerBlock = Adpcm ? ((((BlockAlign / NumberChannels) - 4) * 2) + 1) : 1;
+      constexpr static std::uint32_t ByteRate = (SampleRate * BlockAlign) / SamplesPerBlock;
+      // the fact chunk that follows fmt for compressed formats, holding the number of frames
+      constexpr static std::uint32_t FactSize = Compressed ? 4 + 4 + 4 : 0;
 
-      constexpr static auto number_samples(seconds seconds, block_size blockSize) -> std::uint32_t
+      // samples per channel
+      constexpr static auto number_frames(seconds seconds, block_size blockSize) -> std::uint32_t
       {
         // ensure we end up with a whole number of blocks
-        std::uint32_t samples = seconds.period * SampleRate * NumberChannels;
+        std::uint32_t samples = seconds.period * SampleRate;
         return ((samples / blockSize.samplesPerBlock) + 1) * blockSize.samplesPerBlock;
       }
 
+      // samples across all channels
+      constexpr static auto number_samples(seconds seconds, block_size blockSize) -> std::uint32_t
+      {
+        return number_frames(seconds, blockSize) * NumberChannels;
+      }
+
+      // the last ADPCM block is padded to a full block
       constexpr static auto sample_data_length(seconds seconds, block_size blockSize) -> std::uint32_t
       {
-        return number_samples(seconds, blockSize) * BytesPerSample;
+        return ((number_frames(seconds, blockSize) + SamplesPerBlock - 1) / SamplesPerBlock) * BlockAlign;
       }
 
       constexpr static void render(std::span<std::byte, Size> buffer)
       {
-        detail::write_be(buffer.subspan<0, 4>(), SubChunkId);
-        detail::write_le(buffer.subspan<4, 4>(), SubChunkSize);
-        detail::write_le(buffer.subspan<8, 2>(), AudioFormat);
-        detail::write_le(buffer.subspan<10, 2>(), NumberChannels);
-        detail::write_le(buffer.subspan<12, 4>(), SampleRate);
-        detail::write_le(buffer.subspan<16, 4>(), ByteRate);
-        detail::write_le(buffer.subspan<20, 2>(), BlockAlign);
-        detail::write_le(buffer.subspan<22, 2>(), BitsPerSample);
+        detail::write_be(buffer.template subspan<0, 4>(), SubChunkId);
+        detail::write_le(buffer.template subspan<4, 4>(), SubChunkSize);
+        detail::write_le(buffer.template subspan<8, 2>(), AudioFormat);
+        detail::write_le(buffer.template subspan<10, 2>(), NumberChannels);
+        detail::write_le(buffer.template subspan<12, 4>(), SampleRate);
+        detail::write_le(buffer.template subspan<16, 4>(), ByteRate);
+        detail::write_le(buffer.template subspan<20, 2>(), BlockAlign);
+        detail::write_le(buffer.template subspan<22, 2>(), BitsPerSample);
+        if constexpr (Compressed) {
+          detail::write_le(buffer.template subspan<24, 2>(), std::uint16_t{ Adpcm ? 2 : 0 });  // extension size
+        }
+        if constexpr (Adpcm) {
+          detail::write_le(buffer.template subspan<26, 2>(), SamplesPerBlock);
+        }
+      }
+
+      constexpr static void render_fact(std::span<std::byte, FactSize> buffer, std::uint32_t frames)
+        requires Compressed
+      {
+        detail::write_be(buffer.template subspan<0, 4>(), std::uint32_t{ 0x66616374 });  // "fact", big endian
+        detail::write_le(buffer.template subspan<4, 4>(), std::uint32_t{ 4 });
+        detail::write_le(buffer.template subspan<8, 4>(), frames);
       }
     };
 
@@ -95,7 +144,7 @@ namespace tmp {
       }
     };
 
-    template<sample_rate RATE>
+    template<sample_rate RATE, typename FMT = wav_fmt_chunk<RATE>>
     struct riff_header
     {
       constexpr static std::uint32_t Size = 4 * 3;
@@ -104,7 +153,7 @@ namespace tmp {
 
       constexpr static void render(std::span<std::byte, Size> buffer, std::uint32_t sampleDataLength)
       {
-        std::uint32_t chunkSize = 4 + wav_fmt_chunk<RATE>::Size + wav_data_chunk_header::Size + sampleDataLength;
+        std::uint32_t chunkSize = 4 + FMT::Size + FMT::FactSize + wav_data_chunk_header::Size + sampleDataLength;
 
         detail::write_be(buffer.subspan<0, 4>(), ChunkId);
         detail::write_le(buffer.subspan<4, 4>(), chunkSize);
@@ -112,47 +161,270 @@ namespace tmp {
       }
     };
 
+    // The sample rates tools handle when they only learn the rate at run time, each is an instantiation
+    constexpr std::array<std::uint32_t, 8> CommonRates{ 8'000, 8'192, 11'025, 16'000, 22'050, 32'000, 44'100, 48'000 };
+
+    template<sample_rate RATE, std::uint16_t CHANNELS>
+    struct pcm16_header
+    {
+      using Fmt = wav_fmt_chunk<RATE, CHANNELS>;
+      using RiffHdr = riff_header<RATE, Fmt>;
+      using WavHdr = wav_data_chunk_header;
+
+      constexpr static std::size_t Size = RiffHdr::Size + Fmt::Size + WavHdr::Size;
+
+      constexpr static void render(std::span<std::byte, Size> buffer, std::uint32_t sampleDataLength)
+      {
+        RiffHdr::render(buffer.template subspan<0, RiffHdr::Size>(), sampleDataLength);
+        Fmt::render(buffer.template subspan<RiffHdr::Size, Fmt::Size>());
+        WavHdr::render(buffer.template subspan<RiffHdr::Size + Fmt::Size, WavHdr::Size>(), sampleDataLength);
+      }
+    };
+
+    // The header of a 16 bit PCM file with the rate and channels only known at run time, which must be one
+    // of CommonRates and mono or stereo. Returns false for other rates.
+    constexpr auto render_pcm16_header(std::span<std::byte, pcm16_header<sample_rate{ 8'000 }, 1>::Size> buffer,
+      std::uint32_t sampleRate,
+      std::uint16_t channels,
+      std::uint32_t sampleDataLength) -> bool
+    {
+      auto render = [&]<sample_rate RATE>() {
+        if (sampleRate != RATE.samples_per_second) {
+          return false;
+        }
+        if (channels == 2) {
+          pcm16_header<RATE, 2>::render(buffer, sampleDataLength);
+        } else {
+          pcm16_header<RATE, 1>::render(buffer, sampleDataLength);
+        }
+        return true;
+      };
+      return [&]<std::size_t... R>(std::index_sequence<R...>) {
+        return (render.template operator()<sample_rate{ CommonRates[R] }>() or ...);
+      }(std::make_index_sequence<CommonRates.size()>{});
+    }
+
+    //
+    // Render one block from `source` and encode it to `out` as 16 bit PCM, interleaved for stereo.
+    //
+    // Stereo sources render a planar block per channel and the encoder interleaves them as it writes,
+    // so there is no separate interleave copy. A mono source in a stereo file is encoded to both
+    // channels from its one block. The mono path is the plain mono encoder.
+    //
+    // With `stats` the samples that will be clipped are counted and the encoding is timed.
+    //
+    template<std::uint16_t CHANNELS,
+      block_size BLOCK_SIZE,
+      pcm_dither DITHER,
+      typename SOURCE,
+      typename STATS = no_render_stats>
+    constexpr void render_pcm16_block(SOURCE &source,
+      std::span<std::byte> out,
+      tpdf_noise &dither,
+      STATS *stats = nullptr)
+    {
+      constexpr auto Samples = BLOCK_SIZE.samplesPerBlock;
+      std::array<float, Samples> left;
+      stats_hook<STATS> hook{ stats };
+
+      if constexpr (CHANNELS == 1) {
+        if (detail::render_block<BLOCK_SIZE>(source, left) == block_state::Silent) {
+          std::ranges::fill(out, std::byte{ 0 });  // 0.0F encodes to all zero bytes
+          return;
+        }
+        if constexpr (STATS::Enabled) {
+          hook.samples_clipped(count_clipped(left));
+        }
+        [[maybe_unused]] auto timer = hook.time(render_stage::Encode);
+        if constexpr (DITHER == pcm_dither::Tpdf) {
+          encode_pcm16(left, out, dither);
+        } else {
+          encode_pcm16(left, out);
+        }
+      } else {
+        std::array<float, Samples> right;
+        std::span<float const> rightChannel{ right };
+        block_state state{};
+        if constexpr (stereo_source<SOURCE, BLOCK_SIZE>) {
+          state = source.template render_stereo<BLOCK_SIZE>(left, right);
+        } else {
+          state = detail::render_block<BLOCK_SIZE>(source, left);
+          rightChannel = left;
+        }
+
+        if (state == block_state::Silent) {
+          std::ranges::fill(out, std::byte{ 0 });
+          return;
+        }
+        if constexpr (STATS::Enabled) {
+          hook.samples_clipped(count_clipped(left) + (stereo_source<SOURCE, BLOCK_SIZE> ? count_clipped(right) : 0));
+        }
+        [[maybe_unused]] auto timer = hook.time(render_stage::Encode);
+        if constexpr (DITHER == pcm_dither::Tpdf) {
+          encode_pcm16_stereo(left, rightChannel, out, dither);
+        } else {
+          encode_pcm16_stereo(left, rightChannel, out);
+        }
+      }
+    }
+
+    //
+    // Render one block from `source` as 16 bit samples for a compressed encoding, interleaved for
+    // stereo. The quantisation and dither sequence are those of render_pcm16_block, but the samples
+    // stay integers, which saves writing bytes and reading them back during constant evaluation.
+    //
+    template<std::uint16_t CHANNELS,
+      block_size BLOCK_SIZE,
+      pcm_dither DITHER,
+      typename SOURCE,
+      typename STATS = no_render_stats>
+    constexpr void render_pcm16_frames(SOURCE &source,
+      std::span<std::int16_t> out,
+      tpdf_noise &dither,
+      STATS *stats = nullptr)
+    {
+      constexpr auto Samples = BLOCK_SIZE.samplesPerBlock;
+      std::array<float, Samples> left;
+      std::array<float, Samples> right;
+      float const *rightChannel = left.data();
+      block_state state{};
+
+      if constexpr (CHANNELS == 2 and stereo_source<SOURCE, BLOCK_SIZE>) {
+        state = source.template render_stereo<BLOCK_SIZE>(left, right);
+        rightChannel = right.data();
+      } else {
+        state = detail::render_block<BLOCK_SIZE>(source, left);
+      }
+
+      if (state == block_state::Silent) {
+        std::ranges::fill(out, std::int16_t{ 0 });
+        return;
+      }
+
+      stats_hook<STATS> hook{ stats };
+      if constexpr (STATS::Enabled) {
+        auto const stereo = CHANNELS == 2 and stereo_source<SOURCE, BLOCK_SIZE>;
+        hook.samples_clipped(count_clipped(left) + (stereo ? count_clipped(right) : 0));
+      }
+      [[maybe_unused]] auto timer = hook.time(render_stage::Encode);
+      auto *pcm = out.data();
+      for (std::size_t i{ 0 }; i < Samples; ++i) {
+        float noise{};
+        if constexpr (DITHER == pcm_dither::Tpdf) {
+          noise = dither.next();
+        }
+        pcm[i * CHANNELS] = static_cast<std::int16_t>(
+          quantise_pcm16(left[i], DITHER == pcm_dither::Tpdf ? &noise : nullptr));
+        if constexpr (CHANNELS == 2) {
+          if constexpr (DITHER == pcm_dither::Tpdf) {
+            noise = dither.next();
+          }
+          pcm[(i * 2) + 1] = static_cast<std::int16_t>(
+            quantise_pcm16(rightChannel[i], DITHER == pcm_dither::Tpdf ? &noise : nullptr));
+        }
+      }
+    }
   }  // namespace detail
 
 
-  template<sample_rate RATE, seconds SECONDS, block_size BLOCK_SIZE = block_size{ 128 }>
-  struct wav_renderer_mono
+  //
+  // Renders a source to a complete WAV file in `data`, at compile time when used to initialise a
+  // constinit variable. Each block is quantised to 16 bit PCM and, for a compressed ENCODING, that PCM
+  // is then compressed into the data chunk (see wav_codec.hpp for the decoders).
+  //
+  template<sample_rate RATE,
+    seconds SECONDS,
+    std::uint16_t CHANNELS,
+    block_size BLOCK_SIZE = block_size{ 128 },
+    pcm_dither DITHER = pcm_dither::None,
+    wav_encoding ENCODING = wav_encoding::Pcm16>
+  struct wav_renderer
   {
     static constexpr sample_rate Rate = RATE;
-    using RiffHdr = detail::riff_header<RATE>;
-    using Fmt = detail::wav_fmt_chunk<RATE>;
+    using Fmt = detail::wav_fmt_chunk<RATE, CHANNELS, ENCODING>;
+    using RiffHdr = detail::riff_header<RATE, Fmt>;
     using WavHdr = detail::wav_data_chunk_header;
 
+    static constexpr std::uint32_t NumFrames = Fmt::number_frames(SECONDS, BLOCK_SIZE);
     static constexpr std::uint32_t NumSamples = Fmt::number_samples(SECONDS, BLOCK_SIZE);
     static constexpr std::uint32_t SampleDataLength = Fmt::sample_data_length(SECONDS, BLOCK_SIZE);
+    static constexpr std::size_t BlockBytes = std::size_t{ BLOCK_SIZE.samplesPerBlock } * Fmt::BlockAlign;
 
-    static constexpr std::size_t TotalSize = RiffHdr::Size + Fmt::Size + WavHdr::Size + SampleDataLength;
+    static constexpr std::size_t HeaderSize = RiffHdr::Size + Fmt::Size + Fmt::FactSize + WavHdr::Size;
+    static constexpr std::size_t TotalSize = HeaderSize + SampleDataLength;
 
     std::array<std::byte, TotalSize> data;
 
     template<typename SOURCE>
     constexpr void render(SOURCE &source)
     {
-      std::span<std::byte, TotalSize> buffer{ data };
+      no_render_stats none{};
+      render(source, none);
+    }
 
-      RiffHdr::render(buffer.template subspan<0, RiffHdr::Size>(), SampleDataLength);
-      Fmt::render(buffer.template subspan<RiffHdr::Size, Fmt::Size>());
-      WavHdr::render(buffer.template subspan<RiffHdr::Size + Fmt::Size, WavHdr::Size>(), SampleDataLength);
+    // Render with statistics, `source` is attached to `stats` if it takes them and a row is added per block
+    template<typename SOURCE, typename STATS>
+    constexpr void render(SOURCE &source, STATS &stats)
+    {
+      if constexpr (STATS::Enabled and requires { source.attach_stats(stats); }) {
+        source.attach_stats(stats);
+      }
+      STATS *blockStats = STATS::Enabled ? &stats : nullptr;
+      detail::stats_hook<STATS> hook{ blockStats };
+
+      std::span<std::byte, TotalSize> buffer{ data };
+      render_header(buffer.template first<HeaderSize>());
 
       auto sampleData = buffer.template last<SampleDataLength>();
-      std::array<float, BLOCK_SIZE.samplesPerBlock> audioData{};
+      detail::tpdf_noise dither{};
 
       // We know we have a full multiple of BLOCK_SIZE blocks because of our calculations in the format helper
-      for (std::size_t block{ 0 }; block < NumSamples; block += BLOCK_SIZE.samplesPerBlock) {
-        source.template render<BLOCK_SIZE>(audioData);
-
-        for (std::size_t sample{ 0 }; sample < BLOCK_SIZE.samplesPerBlock; ++sample) {
-          // encode sample to 16 bit
-          auto clamped = std::clamp(audioData[sample], -1.0F, 1.0F);
-          auto val = static_cast<std::int16_t>(clamped * std::numeric_limits<int16_t>::max());
-          detail::write_le(sampleData.subspan((block + sample) * 2, 2), static_cast<std::uint16_t>(val));
+      if constexpr (Fmt::Compressed) {
+        detail::wav_block_encoder<ENCODING, CHANNELS, Fmt::SamplesPerBlock, Fmt::BlockAlign> encoder{ sampleData };
+        std::array<std::int16_t, std::size_t{ BLOCK_SIZE.samplesPerBlock } * CHANNELS> pcm;
+        for (std::size_t frame{ 0 }; frame < NumFrames; frame += BLOCK_SIZE.samplesPerBlock) {
+          detail::render_pcm16_frames<CHANNELS, BLOCK_SIZE, DITHER>(source, pcm, dither, blockStats);
+          {
+            [[maybe_unused]] auto timer = hook.time(render_stage::Encode);
+            encoder.encode(pcm);
+          }
+          hook.end_block(BLOCK_SIZE.samplesPerBlock);
+        }
+        encoder.finish();
+      } else {
+        for (std::size_t frame{ 0 }; frame < NumFrames; frame += BLOCK_SIZE.samplesPerBlock) {
+          detail::render_pcm16_block<CHANNELS, BLOCK_SIZE, DITHER>(
+            source, sampleData.subspan(frame * Fmt::BlockAlign, BlockBytes), dither, blockStats);
+          hook.end_block(BLOCK_SIZE.samplesPerBlock);
         }
       }
     }
+
+    // the RIFF, fmt (and fact) and data chunk headers for the whole file
+    static constexpr void render_header(std::span<std::byte, HeaderSize> buffer)
+    {
+      RiffHdr::render(buffer.template subspan<0, RiffHdr::Size>(), SampleDataLength);
+      Fmt::render(buffer.template subspan<RiffHdr::Size, Fmt::Size>());
+      if constexpr (Fmt::Compressed) {
+        Fmt::render_fact(buffer.template subspan<RiffHdr::Size + Fmt::Size, Fmt::FactSize>(), NumFrames);
+      }
+      WavHdr::render(buffer.template subspan<HeaderSize - WavHdr::Size, WavHdr::Size>(), SampleDataLength);
+    }
   };
-}  // namespace tmp
\ No newline at end of file
+
+  template<sample_rate RATE,
+    seconds SECONDS,
+    block_size BLOCK_SIZE = block_size{ 128 },
+    pcm_dither DITHER = pcm_dither::None,
+    wav_encoding ENCODING = wav_encoding::Pcm16>
+  using wav_renderer_mono = wav_renderer<RATE, SECONDS, 1, BLOCK_SIZE, DITHER, ENCODING>;
+
+  // Renders a stereo_source (such as stereo_mixer) to interleaved stereo, a mono source goes to both channels
+  template<sample_rate RATE,
+    seconds SECONDS,
+    block_size BLOCK_SIZE = block_size{ 128 },
+    pcm_dither DITHER = pcm_dither::None,
+    wav_encoding ENCODING = wav_encoding::Pcm16>
+  using wav_renderer_stereo = wav_renderer<RATE, SECONDS, 2, BLOCK_SIZE, DITHER, ENCODING>;
+
+}  // namespace tmp
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <semaphore>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "types.hpp"
+#include "wav_render.hpp"
+
+namespace tmp {
+
+  //
+  // Run time WAV writer that streams to a file descriptor instead of holding the whole file in memory,
+  // so the length does not need to be known at compile time and memory stays bounded for long renders.
+  //
+  // Blocks are rendered and encoded into a small ring of BUFFERS buffers, each BLOCKS_PER_BUFFER blocks
+  // long, and a separate writer thread write()s the filled buffers so rendering overlaps with the I/O.
+  //
+  // The header is written up front as if there were no sample data (a data chunk size of 0 and the RIFF
+  // size of the header alone) and patched by finish() once the amount of sample data is known. If the
+  // descriptor is not seekable (a pipe) it is left like that, which most readers treat as "read to the
+  // end of the stream". The sizes are 32 bit, render_blocks() throws std::length_error rather than
+  // write more sample data than they can describe.
+  //
+  //   wav_stream_writer<Rate> writer{ fd };
+  //   writer.render(sequencer, seconds{ 600.0F });
+  //   writer.finish();
+  //
+  // The parameters before BUFFERS are in the order wav_renderer takes them. With CHANNELS = 2 a
+  // stereo_source is written interleaved (wav_stream_writer<Rate, 2>), see wav_renderer_stereo.
+  //
+  template<sample_rate RATE,
+    std::uint16_t CHANNELS = 1,
+    block_size BLOCK_SIZE = block_size{ 128 },
+    pcm_dither DITHER = pcm_dither::None,
+    std::size_t BUFFERS = 4,
+    std::size_t BLOCKS_PER_BUFFER = 64>
+  class wav_stream_writer
+  {
+    static_assert(BUFFERS >= 2, "Need at least two buffers to overlap rendering and writing");
+
+  public:
+    using RiffHdr = detail::riff_header<RATE>;
+    using Fmt = detail::wav_fmt_chunk<RATE, CHANNELS>;
+    using WavHdr = detail::wav_data_chunk_header;
+
+    static constexpr std::size_t HeaderSize = RiffHdr::Size + Fmt::Size + WavHdr::Size;
+    static constexpr std::size_t BlockBytes = std::size_t{ BLOCK_SIZE.samplesPerBlock } * Fmt::BlockAlign;
+    static constexpr std::size_t BufferBytes = BlockBytes * BLOCKS_PER_BUFFER;
+    // the RIFF chunk size counts everything after its own 8 bytes and must fit in 32 bits
+    static constexpr std::uint64_t MaxSampleDataLength = std::numeric_limits<std::uint32_t>::max() - (HeaderSize - 8);
+
+    // does not take ownership of the file descriptor
+    explicit wav_stream_writer(int fd)
+      : m_fd{ fd }
+      , m_headerOffset{ ::lseek(fd, 0, SEEK_CUR) }
+      , m_storage(BUFFERS * BufferBytes)
+    {
+      auto header = make_header(0);
+      write_all(header);
+      m_writer = std::jthread{ [this] { writer_loop(); } };
+    }
+
+    wav_stream_writer(wav_stream_writer const &) = delete;
+    auto operator=(wav_stream_writer const &) -> wav_stream_writer & = delete;
+
+    ~wav_stream_writer()
+    {
+      try {
+        finish();
+      } catch (...) {  // NOLINT(bugprone-empty-catch) destructors must not throw, call finish() to see errors
+      }
+    }
+
+    // render whole blocks covering at least `length`, may be called repeatedly to keep appending
+    template<typename SOURCE>
+    void render(SOURCE &source, seconds length)
+    {
+      auto samples = length.to_samples(RATE);
+      render_blocks(source, (samples + BLOCK_SIZE.samplesPerBlock - 1) / BLOCK_SIZE.samplesPerBlock);
+    }
+
+    template<typename SOURCE>
+    void render_blocks(SOURCE &source, std::size_t numberBlocks)
+    {
+      if ((m_samplesWritten * Fmt::BlockAlign) + (std::uint64_t{ numberBlocks } * BlockBytes) > MaxSampleDataLength) {
+        throw std::length_error{ "WAV sample data would not fit the 32 bit chunk sizes" };
+      }
+      for (std::size_t block{ 0 }; block < numberBlocks; ++block) {
+        if (m_filling == nullptr) {
+          acquire_buffer();
+          throw_if_failed();
+        }
+
+        auto out = std::span<std::byte>{ m_filling->data + m_filling->size, BlockBytes };
+        detail::render_pcm16_block<CHANNELS, BLOCK_SIZE, DITHER>(source, out, m_dither);
+        m_filling->size += BlockBytes;
+        m_samplesWritten += BLOCK_SIZE.samplesPerBlock;
+
+        if (m_filling->size == BufferBytes) {
+          submit_buffer();
+        }
+      }
+    }
+
+    // flush the remaining data, stop the writer thread and patch the header sizes
+    void finish()
+    {
+      if (m_finished) {
+        return;
+      }
+      m_finished = true;
+
+      if (m_filling == nullptr) {
+        acquire_buffer();
+      }
+      if (m_filling->size > 0) {
+        submit_buffer();
+        acquire_buffer();
+      }
+
+      // an empty buffer tells the writer to stop
+      submit_buffer();
+      m_writer.join();
+
+      throw_if_failed();
+
+      if (m_headerOffset >= 0) {
+        auto header = make_header(static_cast<std::uint32_t>(m_samplesWritten * Fmt::BlockAlign));
+        if (::pwrite(m_fd, header.data(), header.size(), m_headerOffset) != static_cast<ssize_t>(header.size())) {
+          throw std::system_error{ errno, std::generic_category(), "patching WAV header" };
+        }
+      }
+    }
+
+    // samples per channel
+    [[nodiscard]] auto samples_written() const -> std::uint64_t
+    {
+      return m_samplesWritten;
+    }
+
+  private:
+    struct buffer
+    {
+      std::byte *data;
+      std::size_t size;
+    };
+
+    int m_fd;
+    off_t m_headerOffset;  // -1 when the descriptor is not seekable
+    std::vector<std::byte> m_storage;
+    std::array<buffer, BUFFERS> m_buffers{};
+    std::counting_semaphore<BUFFERS> m_free{ BUFFERS };
+    std::counting_semaphore<BUFFERS> m_filled{ 0 };
+    std::size_t m_produceIndex{ 0 };
+    buffer *m_filling{ nullptr };
+    std::uint64_t m_samplesWritten{ 0 };
+    detail::tpdf_noise m_dither{};
+    std::atomic<int> m_error{ 0 };
+    bool m_finished{ false };
+    std::jthread m_writer;
+
+    static auto make_header(std::uint32_t sampleDataLength) -> std::array<std::byte, HeaderSize>
+    {
+      std::array<std::byte, HeaderSize> header{};
+      std::span<std::byte, HeaderSize> out{ header };
+      RiffHdr::render(out.template subspan<0, RiffHdr::Size>(), sampleDataLength);
+      Fmt::render(out.template subspan<RiffHdr::Size, Fmt::Size>());
+      WavHdr::render(out.template subspan<RiffHdr::Size + Fmt::Size, WavHdr::Size>(), sampleDataLength);
+      return header;
+    }
+
+    void acquire_buffer()
+    {
+      m_free.acquire();
+      m_filling = &m_buffers[m_produceIndex % BUFFERS];
+      m_filling->data = m_storage.data() + ((m_produceIndex % BUFFERS) * BufferBytes);
+      m_filling->size = 0;
+    }
+
+    void submit_buffer()
+    {
+      ++m_produceIndex;
+      m_filling = nullptr;
+      m_filled.release();
+    }
+
+    void writer_loop()
+    {
+      for (std::size_t consumeIndex{ 0 };; ++consumeIndex) {
+        m_filled.acquire();
+        auto &buf = m_buffers[consumeIndex % BUFFERS];
+        if (buf.size == 0) {
+          return;  // end of stream
+        }
+
+        // keep draining after an error so the producer never blocks, it will see the error
+        if (m_error.load(std::memory_order_relaxed) == 0) {
+          try {
+            write_all(std::span<std::byte const>{ buf.data, buf.size });
+          } catch (std::system_error const &e) {
+            m_error.store(e.code().value(), std::memory_order_relaxed);
+          }
+        }
+        m_free.release();
+      }
+    }
+
+    void write_all(std::span<std::byte const> data) const
+    {
+      while (!data.empty()) {
+        auto written = ::write(m_fd, data.data(), data.size());
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::system_error{ errno, std::generic_category(), "writing WAV data" };
+        }
+        data = data.subspan(static_cast<std::size_t>(written));
+      }
+    }
+
+    void throw_if_failed() const
+    {
+      if (auto error = m_error.load(std::memory_order_relaxed); error != 0) {
+        throw std::system_error{ error, std::generic_category(), "writing WAV data" };
+      }
+    }
+  };
+
+}  // namespace tmp
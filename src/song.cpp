@@ -1,6 +1,8 @@
 #include <array>
 
+#include "tmp/score.hpp"
 #include "tmp/sequencer.hpp"
+#include "tmp/slice_render.hpp"
 #include "tmp/synth.hpp"
 #include "tmp/types.hpp"
 #include "tmp/wav_render.hpp"
@@ -27,20 +29,59 @@ G#3|#   :    :    :    |#   :    :    :    |#   :    :    :  ##|  ##:    :    :
 )" };
 };
 
+using namespace tmp::literals;
+
+// the same settings for every way the song is built below
+//constexpr tmp::sample_rate Rate{ 8'192 };
+constexpr tmp::sample_rate Rate{ 8'000 };
+constexpr tmp::envelope Envelope{ 0.005_sec, 0.0_dBfs, 0.02_sec, -3.0_dBfs, 0.005_sec };
+constexpr auto Volume = -1.0_dBfs;
+
+
+#if defined(TMP_WAV_SCORE)
+
+// add_wav(name SCORE ...) keeps only the events and instrument settings, score-render synthesises them
+[[gnu::section(".wavescore"), gnu::used]]
+constinit auto const ScoreData = [] {
+  using namespace tmp;
+
+  static constexpr auto music_length = parse_music_length(musicSource);
+  static constexpr auto events = bake_music<Rate>(musicSource);
+
+  score_writer<Rate, music_length, events.size()> score{};
+
+  score.write(score_instrument::Sin, Envelope, Volume, events);
+  return score.data;
+}();
+
+#elif defined(TMP_WAV_SLICE)
+
+// add_wav(name SLICES N ...) compiles this N times, each renders its own time slice of the song
+[[gnu::section(".waveslice"), gnu::used]]
+constinit auto const SliceData = [] {
+  using namespace tmp;
+  using namespace tmp::instruments;
+
+  sin_synth<Rate> synth{ Envelope, Volume };
+  sequencer sequencer{ synth };
+
+  static constexpr auto music_length = parse_music_length(musicSource);
+  sequencer.parse_music(musicSource);
+
+  wav_slice_renderer<Rate, music_length, TMP_WAV_SLICE, TMP_WAV_SLICES> slice{};
+
+  slice.render(sequencer);
+  return slice.data;
+}();
+
+#else
 
 [[gnu::section(".wavefile"), gnu::used]]
 constinit auto const WaveData = [] {
   using namespace tmp;
-  using namespace tmp::literals;
   using namespace tmp::instruments;
 
-  //static constexpr sample_rate Rate{ 8'192 };
-  static constexpr sample_rate Rate{ 8'000 };
-
-  sin_synth<Rate> synth{
-    envelope{ 0.005_sec, 0.0_dBfs, 0.02_sec, -3.0_dBfs, 0.005_sec },
-    -1.0_dBfs
-  };
+  sin_synth<Rate> synth{ Envelope, Volume };
   sequencer sequencer{ synth };
 
   static constexpr auto music_length = parse_music_length(musicSource);
@@ -51,3 +92,5 @@ constinit auto const WaveData = [] {
   wav.render(sequencer);
   return wav.data;
 }();
+
+#endif
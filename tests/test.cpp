@@ -4,12 +4,35 @@
  */
 
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tmp/event_inbox.hpp"
+#include "tmp/parallel_render.hpp"
+#include "tmp/realtime.hpp"
+#include "tmp/render_stats.hpp"
+#include "tmp/render_stats_io.hpp"
+#include "tmp/score.hpp"
 #include "tmp/sequencer.hpp"
+#include "tmp/slice_render.hpp"
 #include "tmp/synth.hpp"
 #include "tmp/types.hpp"
+#include "tmp/upsampler.hpp"
+#include "tmp/voice_bank.hpp"
+#include "tmp/wav_codec.hpp"
 #include "tmp/wav_render.hpp"
+#include "tmp/wav_stream.hpp"
 
 auto musicSource = [] -> tmp::music {
        return tmp::music{ tmp::beats_per_minute{ 120 },
@@ -33,6 +56,130 @@ G#3|#   :    :    :    |#   :    :    :    |#   :    :    :  ##|  ##:    :    :
 )" };
 };
 
+// the same tune written with patterns and written out in full
+auto patternSource = [] -> tmp::music {
+  return tmp::music{ tmp::beats_per_minute{ 120 },
+    R"(
+[a]
+   | 1                 |
+C4 |#   :  # :##  :    |
+G3 |  ##:    :  # :#   |
+[b]
+   | 1                 |
+D#4|    :####:    :    |
+G#3|##  :    :  ##:    |
+> a a b a*2
+)" };
+};
+
+auto writtenOutSource = [] -> tmp::music {
+  return tmp::music{ tmp::beats_per_minute{ 120 },
+    R"(
+   | 1                 | 2                 | 3                 | 4                 | 5                 |
+D#4|    :    :    :    |    :    :    :    |    :####:    :    |    :    :    :    |    :    :    :    |
+C4 |#   :  # :##  :    |#   :  # :##  :    |    :    :    :    |#   :  # :##  :    |#   :  # :##  :    |
+G#3|    :    :    :    |    :    :    :    |##  :    :  ##:    |    :    :    :    |    :    :    :    |
+G3 |  ##:    :  # :#   |  ##:    :  # :#   |    :    :    :    |  ##:    :  # :#   |  ##:    :  # :#   |
+)" };
+};
+
+// a source with only the fixed size entry point, as sources were written before render(std::span<float>)
+template<tmp::sample_rate RATE>
+struct fixed_block_source
+{
+  template<tmp::block_size BLOCK_SIZE>
+  constexpr void render(std::span<float, BLOCK_SIZE.samplesPerBlock> buffer)
+  {
+    std::ranges::fill(buffer, 0.25F);
+  }
+};
+
+// The per sample envelope_generator the segment version replaced, kept to check it against
+template<tmp::sample_rate RATE>
+class per_sample_envelope
+{
+public:
+  constexpr explicit per_sample_envelope(tmp::envelope env)
+    : m_attackStep{ env.attackLevel.value / static_cast<float>(env.attackTime.to_samples(RATE)) }
+    , m_attackLevel{ env.attackLevel.value }
+    , m_decayStep{ (env.decayLevel.value - env.attackLevel.value) / static_cast<float>(env.decayTime.to_samples(RATE)) }
+    , m_decayLevel{ env.decayLevel.value }
+    , m_releaseStep{ -env.decayLevel.value / static_cast<float>(env.releaseTime.to_samples(RATE)) }
+  {}
+
+  constexpr void note_on(std::uint32_t startNumberSamplesFromNextBlock, std::uint32_t stopAfterNumberSamples)
+  {
+    m_counting = true;
+    m_sampleCounter = startNumberSamplesFromNextBlock;
+    m_offSampleCounter = stopAfterNumberSamples;
+    m_state = State::Wait;
+  }
+
+  constexpr void apply(std::span<float> buffer)
+  {
+    for (auto &sample : buffer) {
+      switch (m_state) {
+      case State::Wait:
+      case State::Idle:
+        sample = 0.0F;
+        if (note_command(State::Attack)) {
+          m_counting = true;
+          m_sampleCounter = m_offSampleCounter;
+        }
+        break;
+      case State::Attack:
+        m_level += m_attackStep;
+        m_state = m_level >= m_attackLevel ? State::Decay : m_state;
+        sample *= m_level;
+        note_command(State::Release);
+        break;
+      case State::Decay:
+        m_level += m_decayStep;
+        m_state = m_level <= m_decayLevel ? State::Sustain : m_state;
+        sample *= m_level;
+        note_command(State::Release);
+        break;
+      case State::Sustain:
+        sample *= m_decayLevel;
+        note_command(State::Release);
+        break;
+      case State::Release:
+        m_level += m_releaseStep;
+        m_state = m_level <= 0.0F ? State::Idle : m_state;
+        sample *= m_level;
+        break;
+      }
+    }
+  }
+
+private:
+  enum class State : std::uint8_t { Wait, Attack, Decay, Sustain, Release, Idle };
+
+  float m_attackStep;
+  float m_attackLevel;
+  float m_decayStep;
+  float m_decayLevel;
+  float m_releaseStep;
+  State m_state{ State::Wait };
+  float m_level{ 0.0F };
+  bool m_counting{ false };
+  std::uint32_t m_sampleCounter{ 0 };
+  std::uint32_t m_offSampleCounter{ 0 };
+
+  constexpr auto note_command(State nextState) -> bool
+  {
+    if (m_counting) {
+      if (m_sampleCounter == 0) {
+        m_state = nextState;
+        m_counting = false;
+        return true;
+      }
+      --m_sampleCounter;
+    }
+    return false;
+  }
+};
+
 void test_notes()
 {
   using namespace std::literals;
@@ -60,14 +207,25 @@ int main()
 
   test_notes();
 
+  // MIDI note numbers stop at 127, a larger one is an error rather than a read past the name table
+  try {
+    static_cast<void>(note::from_number(200));
+    std::cerr << "note::from_number(200) DID NOT throw\n";
+    return 1;
+  } catch (std::invalid_argument const &) {
+  }
+  event_inbox inbox{ 4 };
+  if (inbox.push(compact_event{ 200, 0, 1 }) or inbox.stats().rejected != 1) {
+    std::cerr << "event inbox: note number 200 DID NOT get rejected\n";
+    return 1;
+  }
+
 
   //static constexpr sample_rate Rate{ 8'192 };
   static constexpr sample_rate Rate{ 8'000 };
+  static constexpr envelope Envelope{ 0.005_sec, 0.0_dBfs, 0.02_sec, -3.0_dBfs, 0.005_sec };
 
-  sin_synth<Rate> synth{
-    envelope{ 0.005_sec, 0.0_dBfs, 0.02_sec, -3.0_dBfs, 0.005_sec },
-    -1.0_dBfs
-  };
+  sin_synth<Rate> synth{ Envelope, -1.0_dBfs };
   sequencer sequencer{ synth };
 
   static constexpr auto music_length = parse_music_length(musicSource);
@@ -77,5 +235,557 @@ int main()
 
   wav.render(sequencer);
 
+  // the same song from an event table baked at compile time should render identically
+  static constexpr auto bakedEvents = bake_music<Rate>(musicSource);
+  sin_synth<Rate> bakedSynth{ Envelope, -1.0_dBfs };
+  tmp::sequencer bakedSequencer{ bakedSynth };
+  bakedSequencer.play_events(bakedEvents);
+
+  wav_renderer_mono<Rate, music_length> bakedWav{};
+  bakedWav.render(bakedSequencer);
+  if (bakedWav.data != wav.data) {
+    std::cerr << "baked events: render DIFFERS from parse_music\n";
+    return 1;
+  }
+  std::cout << bakedEvents.size() << " baked events, render matches parse_music\n";
+
+  // The envelope worked out a segment at a time follows the per sample one it replaced to within an
+  // attack and a decay step. The old threshold tests could run one step past the attack level, which
+  // carries through the decay, and stop the decay one step late. The old level also gathers float
+  // rounding from one addition per sample, 1e-5 covers it over these short ramps.
+  {
+    static constexpr float Bound =
+      (Envelope.attackLevel.value / static_cast<float>(Envelope.attackTime.to_samples(Rate)))
+      + ((Envelope.attackLevel.value - Envelope.decayLevel.value)
+         / static_cast<float>(Envelope.decayTime.to_samples(Rate)))
+      + 1e-5F;
+    std::array<std::pair<std::uint32_t, std::uint32_t>, 5> notes{
+      { { 0, 4'000 }, { 37, 20 }, { 100, 60 }, { 300, 1 }, { 5, 0 } }
+    };
+    float largest = 0.0F;
+    for (auto [start, length] : notes) {
+      sources::envelope_generator<Rate> segments{ Envelope };
+      per_sample_envelope<Rate> perSample{ Envelope };
+      segments.note_on(start, length);
+      perSample.note_on(start, length);
+      for (std::size_t block{ 0 }; block < 40; ++block) {
+        std::array<float, 128> segmentSamples{};
+        segmentSamples.fill(1.0F);
+        auto perSampleSamples = segmentSamples;
+        segments.apply(std::span<float>{ segmentSamples });
+        perSample.apply(std::span<float>{ perSampleSamples });
+        for (std::size_t i{ 0 }; i < segmentSamples.size(); ++i) {
+          largest = std::max(largest, std::abs(segmentSamples[i] - perSampleSamples[i]));
+        }
+      }
+    }
+    if (largest > Bound) {
+      std::cerr << "envelope: DIFFERS from the per sample envelope by " << largest << "\n";
+      return 1;
+    }
+    std::cout << "envelope: within " << largest << " of the per sample envelope (bound " << Bound << ")\n";
+  }
+
+  // a note at or above the sample rate aliases back into range instead of overflowing the phase step
+  static constexpr auto c9 = note::from_number(120).note_frequency;
+  static_assert(sources::detail::phase_increment(c9, Rate)
+                == sources::detail::phase_increment(frequency{ c9.hertz - Rate.samples_per_second }, Rate));
+
+  // with the note cache each distinct note is rendered once, the result should match to float rounding
+  auto render_wavetable = [](auto &instrument) {
+    tmp::sequencer sequencer{ instrument };
+    sequencer.play_events(bakedEvents);
+    auto rendered = std::make_unique<wav_renderer_mono<Rate, music_length>>();
+    rendered->render(sequencer);
+    return rendered;
+  };
+  wavetable_synth<Rate> wavetableSynth{ Envelope, -1.0_dBfs };
+  cached_wavetable_synth<Rate> cachedSynth{ Envelope, -1.0_dBfs };
+  static_assert(sizeof(wavetable_synth<Rate>) < sizeof(cached_wavetable_synth<Rate>), "no cache without memoize");
+  auto directWav = render_wavetable(wavetableSynth);
+  auto cachedWav = render_wavetable(cachedSynth);
+
+  int maxDifference = 0;
+  for (std::size_t i = 44; i + 1 < directWav->data.size(); i += 2) {
+    auto sample = [](auto const &data, std::size_t at) {
+      return static_cast<std::int16_t>(std::to_integer<int>(data[at]) | (std::to_integer<int>(data[at + 1]) << 8));
+    };
+    maxDifference = std::max(maxDifference, std::abs(sample(directWav->data, i) - sample(cachedWav->data, i)));
+  }
+  std::cout << "note cache: " << cachedSynth.cache_stats().misses << " notes rendered, "
+            << cachedSynth.cache_stats().hits << " replayed, largest difference " << maxDifference << " LSB\n";
+  // float rounding can flip the last bit of a sample, anything larger or a cache that never hit is a bug
+  if (maxDifference > 1 or cachedSynth.cache_stats().hits == 0) {
+    std::cerr << "note cache: render DIFFERS from uncached render or was never reused\n";
+    return 1;
+  }
+
+  // repeated patterns are rendered once and copied, which should not change the result
+  {
+    static constexpr auto pattern_length = parse_music_length(patternSource);
+    static_assert(pattern_length.period == parse_music_length(writtenOutSource).period);
+
+    // a repeat count has to be a number of at least one
+    for (std::string_view source : { "[a]\n   | 1                 |\nC4 |#   :  # :##  :    |\n> a*\n",
+           "[a]\n   | 1                 |\nC4 |#   :  # :##  :    |\n> a*0\n" }) {
+      try {
+        static_cast<void>(parse_music_length([source] { return music{ beats_per_minute{ 120 }, source }; }));
+        std::cerr << "patterns: arrangement " << source.substr(source.find('>')) << " DID NOT throw\n";
+        return 1;
+      } catch (std::invalid_argument const &) {
+      }
+    }
+
+    auto render_score = [](auto getMusic) {
+      wavetable_synth<Rate> scoreSynth{ Envelope, -1.0_dBfs };
+      tmp::sequencer scoreSequencer{ scoreSynth };
+      scoreSequencer.parse_music(getMusic);
+      auto rendered = std::make_unique<wav_renderer_mono<Rate, pattern_length>>();
+      rendered->render(scoreSequencer);
+      return std::pair{ std::move(rendered), scoreSequencer.reused_samples() };
+    };
+    auto [patternWav, reused] = render_score(patternSource);
+    auto [writtenOutWav, writtenOutReused] = render_score(writtenOutSource);
+    if (patternWav->data != writtenOutWav->data) {
+      std::cerr << "patterns: render DIFFERS from written out score\n";
+      return 1;
+    }
+    std::cout << "patterns: " << reused << " of " << patternWav->NumSamples << " samples reused, "
+              << "render matches written out score\n";
+
+    // a note queued while the first section is recorded must not end up in the take and every repeat
+    auto render_with_queued_note = [](auto getMusic) {
+      wavetable_synth<Rate> scoreSynth{ Envelope, -1.0_dBfs };
+      tmp::sequencer scoreSequencer{ scoreSynth };
+      scoreSequencer.parse_music(getMusic);
+      constexpr std::size_t Block = 128;
+      std::vector<float> samples(pattern_length.to_samples(Rate) / Block * Block);
+      for (std::size_t at{ 0 }; at < samples.size(); at += Block) {
+        scoreSequencer.render(std::span<float>{ samples }.subspan(at, Block));
+        if (at == 0) { scoreSequencer.queue_event(note{ "E4" }, 4'000U, 6'000U); }
+      }
+      return std::pair{ samples, scoreSequencer.reused_samples() };
+    };
+    auto [queuedPattern, queuedReused] = render_with_queued_note(patternSource);
+    auto [queuedWrittenOut, queuedWrittenOutReused] = render_with_queued_note(writtenOutSource);
+    if (queuedReused == 0 or queuedPattern != queuedWrittenOut) {
+      std::cerr << "patterns: render with a queued note DIFFERS from written out score\n";
+      return 1;
+    }
+    std::cout << "patterns: " << queuedReused << " samples reused with a queued note, render matches\n";
+  }
+
+  // the wavetable part synthesised at half the rate and upsampled should be close to the full rate render
+  {
+    static constexpr sample_rate HalfRate{ Rate.samples_per_second / 2 };
+    static constexpr auto halfRateEvents = bake_music<HalfRate>(musicSource);
+    wavetable_synth<HalfRate> halfRateSynth{ Envelope, -1.0_dBfs };
+    tmp::sequencer halfRateSequencer{ halfRateSynth };
+    halfRateSequencer.play_events(halfRateEvents);
+    upsampler<2, decltype(halfRateSequencer)> upsampled{ halfRateSequencer };
+    auto upsampledWav = std::make_unique<wav_renderer_mono<Rate, music_length>>();
+    upsampledWav->render(upsampled);
+
+    // compare against the full rate render delayed by the filter latency
+    constexpr std::size_t Latency = decltype(upsampled)::Latency * 2;
+    int largest = 0;
+    for (std::size_t i = 44 + Latency; i + 1 < directWav->data.size(); i += 2) {
+      auto sample = [](auto const &data, std::size_t at) {
+        return static_cast<std::int16_t>(std::to_integer<int>(data[at]) | (std::to_integer<int>(data[at + 1]) << 8));
+      };
+      largest = std::max(largest, std::abs(sample(directWav->data, i - Latency) - sample(upsampledWav->data, i)));
+    }
+    std::cout << "upsampler: half rate render within " << (100.0 * largest / 32767) << "% of full scale\n";
+    // the interpolation filter is short, 2% of full scale leaves room for it but not for a misaligned render
+    if (largest > 32767 / 50) {
+      std::cerr << "upsampler: half rate render DIFFERS by more than 2% of full scale\n";
+      return 1;
+    }
+  }
+
+  // the band limited oscillators evaluate at compile time and stay within full scale
+  {
+    static constexpr auto peak = []<template<sample_rate> typename OSCILLATOR>() {
+      OSCILLATOR<Rate> oscillator{ 440.0_hz, volume{ 1.0F } };
+      std::array<float, 512> samples{};
+      oscillator.render(std::span<float>{ samples });
+      return std::abs(std::ranges::max(samples, {}, [](float s) { return std::abs(s); }));
+    };
+    static constexpr float sawPeak = peak.operator()<sources::saw_oscillator>();
+    static constexpr float squarePeak = peak.operator()<sources::square_oscillator>();
+    static constexpr float trianglePeak = peak.operator()<sources::triangle_oscillator>();
+    // the blep corrections overshoot a little around the saw and square edges, the triangle has no edges
+    static_assert(sawPeak <= 1.1F and squarePeak <= 1.1F and trianglePeak <= 1.0F);
+    std::cout << "polyblep: peak saw " << sawPeak << ", square " << squarePeak << ", triangle " << trianglePeak
+              << "\n";
+  }
+
+  // the voice bank renders the song as the per note synth does, below 1 LSB apart
+  {
+    // in blocks, one render of the whole song would start every note at once and fill the bank
+    auto render_floats = [](auto &instrument) {
+      tmp::sequencer sequencer{ instrument };
+      sequencer.play_events(bakedEvents);
+      constexpr std::size_t Block = 128;
+      std::vector<float> samples(music_length.to_samples(Rate) / Block * Block);
+      for (std::size_t at{ 0 }; at < samples.size(); at += Block) {
+        sequencer.render(std::span<float>{ samples }.subspan(at, Block));
+      }
+      return samples;
+    };
+    auto largest_difference = [](std::span<float const> a, std::span<float const> b) {
+      float largest = 0.0F;
+      for (std::size_t i{ 0 }; i < a.size(); ++i) {
+        largest = std::max(largest, std::abs(a[i] - b[i]));
+      }
+      return largest;
+    };
+    static constexpr float Lsb = 1.0F / 32768.0F;
+
+    wavetable_synth<Rate> noteSynth{ Envelope, -1.0_dBfs };
+    wavetable_bank_synth<Rate> bankSynth{ Envelope, -1.0_dBfs };
+    auto bankDifference = largest_difference(render_floats(noteSynth), render_floats(bankSynth));
+    if (bankDifference >= Lsb) {
+      std::cerr << "voice bank: render DIFFERS from wavetable_synth by " << bankDifference << "\n";
+      return 1;
+    }
+
+    // Eight notes ten samples apart fill an eight voice bank, a ninth starts once they all sound. Each
+    // policy should then sound the same as a bank that never had the note it stole or dropped.
+    auto render_bank = []<voice_steal_policy POLICY>(std::initializer_list<std::uint8_t> notes, bool ninth) {
+      voice_bank<Rate, sources::wavetable_oscillator, 8, POLICY> bank{ Envelope, -1.0_dBfs };
+      for (auto n : notes) {
+        bank.play_note(note::from_number(60 + n), n * 10U, 4'000U);
+      }
+      std::array<float, 96> opening{};
+      bank.render(std::span<float>{ opening });
+      if (ninth) {
+        bank.play_note(note::from_number(68), 0, 4'000U);
+      }
+      std::array<float, 512> samples{};
+      bank.render(std::span<float>{ samples });
+      return samples;
+    };
+    using enum voice_steal_policy;
+    auto oldest = largest_difference(render_bank.operator()<Oldest>({ 0, 1, 2, 3, 4, 5, 6, 7 }, true),
+      render_bank.operator()<Oldest>({ 1, 2, 3, 4, 5, 6, 7 }, true));
+    // the latest note is still in its attack, the quietest
+    auto quietest = largest_difference(render_bank.operator()<Quietest>({ 0, 1, 2, 3, 4, 5, 6, 7 }, true),
+      render_bank.operator()<Quietest>({ 0, 1, 2, 3, 4, 5, 6 }, true));
+    auto dropped = largest_difference(render_bank.operator()<None>({ 0, 1, 2, 3, 4, 5, 6, 7 }, true),
+      render_bank.operator()<None>({ 0, 1, 2, 3, 4, 5, 6, 7 }, false));
+    if (oldest >= Lsb or quietest >= Lsb or dropped >= Lsb) {
+      std::cerr << "voice bank: stealing DIFFERS, oldest " << oldest << ", quietest " << quietest << ", none "
+                << dropped << "\n";
+      return 1;
+    }
+    std::cout << "voice bank: largest difference " << bankDifference << ", stealing oldest " << oldest
+              << ", quietest " << quietest << ", none " << dropped << "\n";
+  }
+
+  // Rendered on several threads the song should match a serial render: the fixed point wavetable_oscillator
+  // to within 1e-6 (an envelope resumed part way through a ramp may round differently) and sin_oscillator,
+  // whose float phase rounds differently when a segment starts part way through a note, within 16 LSB.
+  {
+    auto parallel_difference = [](auto &instrument) {
+      tmp::sequencer song{ instrument };
+      song.play_events(bakedEvents);
+      auto const length = music_length.to_samples(Rate);
+      std::vector<float> parallel(length);
+      render_parallel(song, instrument, parallel, 4);
+
+      constexpr std::size_t Block = 128;
+      std::vector<float> serial(length);
+      for (std::size_t at{ 0 }; at < length; at += Block) {
+        song.render(std::span<float>{ serial }.subspan(at, std::min(Block, length - at)));
+      }
+
+      float largest = 0.0F;
+      for (std::size_t i{ 0 }; i < length; ++i) {
+        largest = std::max(largest, std::abs(parallel[i] - serial[i]));
+      }
+      return largest;
+    };
+    wavetable_synth<Rate> wavetableParallel{ Envelope, -1.0_dBfs };
+    sin_synth<Rate> sinParallel{ Envelope, -1.0_dBfs };
+    auto wavetableDifference = parallel_difference(wavetableParallel);
+    auto sinDifference = parallel_difference(sinParallel);
+    if (wavetableDifference > 1e-6F or sinDifference > 16.0F / 32768.0F) {
+      std::cerr << "parallel render: DIFFERS from serial render, wavetable " << wavetableDifference << ", sin "
+                << sinDifference << "\n";
+      return 1;
+    }
+    std::cout << "parallel render: wavetable within " << wavetableDifference << " of serial render, sin within "
+              << sinDifference * 32768.0F << " LSB\n";
+  }
+
+  // the mixers hand a source with only render<BLOCK_SIZE>() whole blocks from their own fixed size entry points
+  {
+    static constexpr auto mixed = [] {
+      mixer<Rate, fixed_block_source> monoMix{ fixed_block_source<Rate>{} };
+      stereo_mixer stereoMix{ std::array{ pan{ 0.0F } }, fixed_block_source<Rate>{} };
+      std::array<float, 512> mono{};
+      std::array<float, 512> left{};
+      std::array<float, 512> right{};
+      monoMix.render<block_size{ 512 }>(std::span{ mono });
+      stereoMix.render_stereo<block_size{ 512 }>(std::span{ left }, std::span{ right });
+      return std::array{ mono.back(), left.back(), right.back() };
+    }();
+    static_assert(mixed[0] == 0.25F and mixed[1] > 0.0F and mixed[1] == mixed[2]);
+  }
+
+  // compressed renders of the song should decode back to close to the 16 bit render, 4 bit ADPCM gives
+  // about 34 dB on this song and 8 bit G.711 about 38 dB, a few dB lower is a broken encoder
+  {
+    auto compare = [&]<wav_encoding ENCODING>(char const *name, char const *fileName, double minimumSnr) {
+      using renderer = wav_renderer_mono<Rate, music_length, block_size{ 128 }, pcm_dither::None, ENCODING>;
+      sin_synth<Rate> codecSynth{ Envelope, -1.0_dBfs };
+      tmp::sequencer codecSequencer{ codecSynth };
+      codecSequencer.play_events(bakedEvents);
+      auto compressed = std::make_unique<renderer>();
+      compressed->render(codecSequencer);
+
+      std::span<std::byte const> data = std::span{ compressed->data }.subspan(renderer::HeaderSize);
+      std::array<std::int16_t, renderer::Fmt::SamplesPerBlock> decoded{};
+      std::int64_t error = 0;
+      std::int64_t signal = 0;
+      for (std::size_t frame = 0; frame < renderer::NumFrames;) {
+        std::size_t count = 0;
+        if constexpr (ENCODING == wav_encoding::ImaAdpcm) {
+          count = decode_ima_adpcm_block(data.first(renderer::Fmt::BlockAlign), decoded);
+          data = data.subspan(renderer::Fmt::BlockAlign);
+        } else {
+          count = decode_g711<ENCODING>(data.first(std::min(decoded.size(), data.size())), decoded);
+          data = data.subspan(count);
+        }
+        for (std::size_t i = 0; i < count and frame < renderer::NumFrames; ++i, ++frame) {
+          auto at = 44 + (frame * 2);
+          std::int64_t original =
+            static_cast<std::int16_t>(std::to_integer<int>(wav.data[at]) | (std::to_integer<int>(wav.data[at + 1]) << 8));
+          signal += original * original;
+          error += (original - decoded[i]) * (original - decoded[i]);
+        }
+      }
+      auto snr = 10.0 * std::log10(static_cast<double>(signal) / static_cast<double>(std::max<std::int64_t>(error, 1)));
+      std::cout << name << ": " << renderer::TotalSize << " bytes (16 bit " << wav.data.size() << "), SNR " << snr
+                << " dB\n";
+
+      int codecFd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (codecFd >= 0) {
+        [[maybe_unused]] auto written = ::write(codecFd, compressed->data.data(), compressed->data.size());
+        ::close(codecFd);
+      }
+      if (snr < minimumSnr) {
+        std::cerr << name << ": decoded render DIFFERS, SNR below " << minimumSnr << " dB\n";
+        return false;
+      }
+      return true;
+    };
+    if (!compare.operator()<wav_encoding::ImaAdpcm>("ima adpcm", "runtime-test-adpcm.wav", 30.0)
+        or !compare.operator()<wav_encoding::MuLaw>("mu-law", "runtime-test-mulaw.wav", 35.0)
+        or !compare.operator()<wav_encoding::ALaw>("a-law", "runtime-test-alaw.wav", 35.0)) {
+      return 1;
+    }
+  }
+
+  // the song kept as its score, synthesised block by block and on demand, should match the render
+  {
+    static constexpr auto score = [] {
+      score_writer<Rate, music_length, bakedEvents.size()> writer{};
+      writer.write(score_instrument::Sin, Envelope, -1.0_dBfs, bakedEvents);
+      return writer;
+    }();
+    static_assert(score.NumFrames == decltype(wav)::NumFrames);
+
+    score_player<Rate, score_instrument::Sin> player{ score.data };
+    auto scoreWav = std::make_unique<wav_renderer_mono<Rate, music_length>>();
+    scoreWav->render(player);
+
+    // nothing is rendered until it is asked for, then only up to the end of that block
+    score_buffer<Rate, score_instrument::Sin> buffer{ score.data };
+    auto firstSecond = buffer.samples(0, Rate.samples_per_second).size();
+    auto rendered = buffer.rendered();
+    auto wholeSong = buffer.samples(0, buffer.frames()).size();
+    if (scoreWav->data != wav.data) {
+      std::cerr << "score: render DIFFERS\n";
+      return 1;
+    }
+    std::cout << "score: " << score.data.size() << " bytes, render matches\n"
+              << "score buffer: " << rendered << " samples rendered for " << firstSecond << ", " << buffer.rendered()
+              << " for " << wholeSong << "\n";
+  }
+
+  // time slices rendered separately, each seeking to its start, should concatenate to the whole render
+  {
+    static constexpr std::size_t Slices = 3;
+    std::vector<std::byte> sliced;
+    [&]<std::size_t... SLICE>(std::index_sequence<SLICE...>) {
+      auto render_slice = [&]<std::size_t S>() {
+        sin_synth<Rate> sliceSynth{ Envelope, -1.0_dBfs };
+        tmp::sequencer sliceSequencer{ sliceSynth };
+        sliceSequencer.parse_music(musicSource);
+        auto slice = std::make_unique<wav_slice_renderer<Rate, music_length, S, Slices>>();
+        slice->render(sliceSequencer);
+        sliced.insert(sliced.end(), slice->data.begin(), slice->data.end());
+      };
+      (render_slice.template operator()<SLICE>(), ...);
+    }(std::make_index_sequence<Slices>{});
+    // sin_oscillator works out a resumed note's phase instead of accumulating it, so allow float rounding,
+    // the song has come out 3 LSB apart
+    static constexpr int MaxSliceDifference = 8;
+    int sliceDifference = 0;
+    for (std::size_t i = 44; i + 1 < std::min(sliced.size(), wav.data.size()); i += 2) {
+      auto sample = [](auto const &data, std::size_t at) {
+        return static_cast<std::int16_t>(std::to_integer<int>(data[at]) | (std::to_integer<int>(data[at + 1]) << 8));
+      };
+      sliceDifference = std::max(sliceDifference, std::abs(sample(sliced, i) - sample(wav.data, i)));
+    }
+    bool const sameHeader = std::equal(sliced.begin(), sliced.begin() + 44, wav.data.begin());
+    std::cout << Slices << " slices: " << sliced.size() << " bytes, " << (sameHeader ? "" : "header DIFFERS, ")
+              << "largest difference " << sliceDifference << " LSB\n";
+    if (!sameHeader or sliced.size() != wav.data.size() or sliceDifference > MaxSliceDifference) {
+      std::cerr << Slices << " slices: concatenated render DIFFERS from the whole render\n";
+      return 1;
+    }
+  }
+
+  // statistics work during constant evaluation, the opening never has more than a few notes sounding
+  {
+    static constexpr auto openingPeakVoices = [] {
+      traced_synth<sources::sin_oscillator>::type<Rate> tracedSynth{ Envelope, -1.0_dBfs };
+      tmp::sequencer tracedSequencer{ tracedSynth };
+      tracedSequencer.play_events(bakedEvents);
+      render_stats stats;
+      auto opening = std::make_unique<wav_renderer_mono<Rate, seconds{ 2.0F }>>();
+      opening->render(tracedSequencer, stats);
+      return stats.peak_voices();
+    }();
+    static_assert(openingPeakVoices > 0 and openingPeakVoices <= 4);
+
+    // and at run time they are timed too, one CSV row per block
+    traced_synth<sources::sin_oscillator>::type<Rate> tracedSynth{ Envelope, -1.0_dBfs };
+    tmp::sequencer tracedSequencer{ tracedSynth };
+    tracedSequencer.parse_music(musicSource);
+    render_stats stats;
+    auto tracedWav = std::make_unique<wav_renderer_mono<Rate, music_length>>();
+    tracedWav->render(tracedSequencer, stats);
+
+    std::uint64_t sequencerTime = 0;
+    for (auto const &block : stats.blocks()) {
+      sequencerTime += block.nanoseconds[static_cast<std::size_t>(render_stage::Sequencer)];
+    }
+    if (tracedWav->data != wav.data) {
+      std::cerr << "stats: render DIFFERS\n";
+      return 1;
+    }
+    std::cout << "stats: " << stats.blocks().size() << " blocks, peak " << stats.peak_voices() << " voices (opening "
+              << openingPeakVoices << "), " << stats.total(&block_stats::events) << " events, "
+              << stats.total(&block_stats::culled) << " culled, " << stats.total(&block_stats::clipped)
+              << " clipped, " << sequencerTime / 1000 << " us in the sequencer, render matches\n";
+
+    // a patterned score counts the events of the sections it plays, and none for the ones it replays
+    static constexpr auto pattern_length = parse_music_length(patternSource);
+    auto render_pattern_stats = [](auto getMusic) {
+      traced_synth<sources::sin_oscillator>::type<Rate> patternSynth{ Envelope, -1.0_dBfs };
+      tmp::sequencer patternSequencer{ patternSynth };
+      patternSequencer.parse_music(getMusic);
+      render_stats patternStats;
+      auto patternWav = std::make_unique<wav_renderer_mono<Rate, pattern_length>>();
+      patternWav->render(patternSequencer, patternStats);
+      return std::pair{ std::move(patternStats), patternSequencer.reused_samples() };
+    };
+    auto [patternStats, patternReused] = render_pattern_stats(patternSource);
+    auto [writtenOutStats, writtenOutReused] = render_pattern_stats(writtenOutSource);
+    // "> a a b a*2", five sections of one bar each, a is recorded the first time and replayed after that
+    static constexpr std::array Replayed{ false, true, false, true, true };
+    static constexpr auto SectionSamples = pattern_length.to_samples(Rate) / Replayed.size();
+    std::uint64_t replayedSamples = 0;
+    bool eventsCounted = patternStats.total(&block_stats::events) > 0
+                         and patternStats.blocks().size() == writtenOutStats.blocks().size();
+    for (std::size_t b = 0; eventsCounted and b < patternStats.blocks().size(); ++b) {
+      auto const &played = patternStats.blocks()[b];
+      auto const &written = writtenOutStats.blocks()[b];
+      auto const section = played.firstSample / SectionSamples;  // the last block runs past the arrangement
+      if (section < Replayed.size() and Replayed[section]) {
+        eventsCounted = played.events == 0 and played.voices == 0 and played.culled == 0;
+        replayedSamples += played.samples;
+      } else {
+        eventsCounted = played.firstSample == written.firstSample and played.samples == written.samples
+                        and played.voices == written.voices and played.peakVoices == written.peakVoices
+                        and played.events == written.events and played.culled == written.culled
+                        and played.clipped == written.clipped;
+      }
+    }
+    if (!eventsCounted or replayedSamples != patternReused or writtenOutReused != 0) {
+      std::cerr << "stats: patterned score events DIFFER from written out score\n";
+      return 1;
+    }
+    std::cout << "stats: patterned score " << patternStats.total(&block_stats::events) << " events, written out "
+              << writtenOutStats.total(&block_stats::events) << ", " << replayedSamples << " samples replayed\n";
+
+    std::ofstream csv{ "runtime-test-stats.csv" };
+    write_csv(stats, csv);
+  }
+
+  // render the same song again at run time, streaming it to a file
+  sin_synth<Rate> streamSynth{ Envelope, -1.0_dBfs };
+  tmp::sequencer streamSequencer{ streamSynth };
+  streamSequencer.parse_music(musicSource);
+
+  int fd = ::open("runtime-test.wav", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "unable to open runtime-test.wav\n";
+    return 1;
+  }
+  {
+    wav_stream_writer<Rate> writer{ fd };
+    writer.render(streamSequencer, music_length);
+    writer.finish();
+  }
+  ::close(fd);
+
+  // and the first two seconds live, through the real time engine to a raw PCM file
+  {
+    sin_synth<Rate> liveSynth{ Envelope, -1.0_dBfs };
+    tmp::sequencer liveSequencer{ liveSynth };
+    liveSequencer.parse_music(musicSource);
+
+    fd = ::open("runtime-test-live.pcm", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      std::cerr << "unable to open runtime-test-live.pcm\n";
+      return 1;
+    }
+    realtime_engine<Rate> engine{ fd_sink{ fd } };
+    engine.play(liveSequencer, seconds{ 2.0F });
+    ::close(fd);
+
+    auto stats = engine.stats();
+    std::cout << "live: " << stats.blocksPlayed << " blocks, " << stats.underruns << " underruns, latency "
+              << std::chrono::duration<double, std::milli>(stats.meanLatency).count() << " ms, headroom "
+              << std::chrono::duration<double, std::milli>(stats.minHeadroom).count() << " of "
+              << std::chrono::duration<double, std::milli>(stats.blockPeriod).count() << " ms per block\n";
+  }
+
+  // and in stereo, the part on two different synths panned apart
+  sin_synth<Rate> leftSynth{ Envelope, -4.0_dBfs };
+  wavetable_synth<Rate> rightSynth{ Envelope, -4.0_dBfs };
+  tmp::sequencer leftSequencer{ leftSynth };
+  tmp::sequencer rightSequencer{ rightSynth };
+  leftSequencer.parse_music(musicSource);
+  rightSequencer.parse_music(musicSource);
+  stereo_mixer stereo{ std::array{ pan{ -0.7F }, pan{ 0.7F } }, leftSequencer, rightSequencer };
+
+  fd = ::open("runtime-test-stereo.wav", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "unable to open runtime-test-stereo.wav\n";
+    return 1;
+  }
+  {
+    wav_stream_writer<Rate, 2> writer{ fd };
+    writer.render(stereo, music_length);
+    writer.finish();
+  }
+  ::close(fd);
+
   return 0;
 }
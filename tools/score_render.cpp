@@ -0,0 +1,75 @@
+/*
+ * Synthesises a score to a 16 bit WAV, run by the add_wav(... SCORE ...) targets:
+ *
+ *   score-render output.wav score
+ *
+ * The score is the raw .wavescore section of a song object (see tmp/score.hpp). It is played with the
+ * same sequencer and synth a pre-rendered song uses and encoded the way wav_renderer_mono does, so for a
+ * song that renders identically at compile and run time the output matches the pre-rendered WAV.
+ */
+
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tmp/score.hpp"
+#include "tmp/wav_stream.hpp"
+
+namespace {
+  auto read_score(std::string const &path) -> std::vector<std::byte>
+  {
+    std::ifstream file{ path, std::ios::binary };
+    if (not file) {
+      throw std::runtime_error{ "unable to open " + path };
+    }
+    std::vector<char> raw{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    auto const *bytes = reinterpret_cast<std::byte const *>(raw.data());
+    return std::vector<std::byte>{ bytes, bytes + raw.size() };
+  }
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc != 3) {
+    std::cerr << "usage: score-render output.wav score\n";
+    return 2;
+  }
+
+  try {
+    auto const score = read_score(argv[2]);
+
+    int fd = ::open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error{ std::string{ "unable to open " } + argv[1] };
+    }
+
+    try {
+      tmp::visit_score(score, [fd](auto &player) {
+        constexpr tmp::block_size BlockSize{ 128 };
+        tmp::wav_stream_writer<std::remove_cvref_t<decltype(player)>::Rate, 1, BlockSize> writer{ fd };
+        writer.render_blocks(player, (player.frames() + BlockSize.samplesPerBlock - 1) / BlockSize.samplesPerBlock);
+        writer.finish();
+      });
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+  } catch (std::exception const &e) {
+    std::cerr << "score-render: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Sums the stems of a song and encodes them to a 16 bit WAV, run by the add_wav(... STEMS ...) targets:
+ *
+ *   stem-mix output.wav stem...
+ *
+ * Each stem is the raw .wavestem section of a stem object (see tmp/stem_render.hpp). Stems must share a
+ * sample rate, the output is stereo if any stem is and as long as the longest stem. Mono stems in a stereo
+ * mix go to both channels, and the rate must be one of tmp::detail::CommonRates. Summing is done in float,
+ * but the parts are summed in a different order to a single render of the whole song, so in general the
+ * result only matches that to float rounding.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tmp/pcm_encode.hpp"
+#include "tmp/stem_render.hpp"
+#include "tmp/wav_render.hpp"
+
+namespace {
+  struct stem
+  {
+    tmp::detail::stem_header header;
+    std::vector<float> samples;  // interleaved
+  };
+
+  auto read_stem(std::string const &path) -> stem
+  {
+    std::ifstream file{ path, std::ios::binary };
+    if (not file) {
+      throw std::runtime_error{ "unable to open " + path };
+    }
+    std::vector<char> raw{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    std::span<std::byte const> bytes{ reinterpret_cast<std::byte const *>(raw.data()), raw.size() };
+
+    stem result{ tmp::detail::stem_header::parse(bytes), {} };
+    result.samples.resize(std::size_t{ result.header.frames } * result.header.channels);
+    auto data = bytes.subspan(tmp::detail::stem_header::Size);
+    for (std::size_t i{ 0 }; i < result.samples.size(); ++i) {
+      result.samples[i] = std::bit_cast<float>(tmp::detail::stem_header::read_le32(data.subspan(i * 4, 4)));
+    }
+    return result;
+  }
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 3) {
+    std::cerr << "usage: stem-mix output.wav stem...\n";
+    return 2;
+  }
+
+  try {
+    std::vector<stem> stems;
+    for (int i{ 2 }; i < argc; ++i) {
+      stems.push_back(read_stem(argv[i]));
+    }
+
+    std::uint32_t const sampleRate = stems.front().header.sampleRate;
+    std::uint16_t channels{ 1 };
+    std::uint32_t frames{ 0 };
+    for (std::size_t i{ 0 }; i < stems.size(); ++i) {
+      if (stems[i].header.sampleRate != sampleRate) {
+        throw std::runtime_error{ std::string{ argv[i + 2] } + " has a different sample rate to "
+                                  + argv[2] };
+      }
+      channels = std::max(channels, stems[i].header.channels);
+      frames = std::max(frames, stems[i].header.frames);
+    }
+
+    std::vector<float> mix(std::size_t{ frames } * channels, 0.0F);
+    for (auto const &s : stems) {
+      if (s.header.channels == channels) {
+        std::transform(s.samples.begin(), s.samples.end(), mix.begin(), mix.begin(), std::plus{});
+      } else {
+        for (std::size_t f{ 0 }; f < s.header.frames; ++f) {
+          mix[f * 2] += s.samples[f];
+          mix[(f * 2) + 1] += s.samples[f];
+        }
+      }
+    }
+
+    // the mix is already interleaved, so it encodes as one long run of samples
+    constexpr std::size_t HeaderSize = tmp::detail::pcm16_header<tmp::sample_rate{ 8'000 }, 1>::Size;
+    std::uint32_t const sampleDataLength = static_cast<std::uint32_t>(mix.size()) * 2;
+    std::vector<std::byte> wav(HeaderSize + std::size_t{ sampleDataLength });
+    if (not tmp::detail::render_pcm16_header(
+          std::span<std::byte, HeaderSize>{ wav.data(), HeaderSize }, sampleRate, channels, sampleDataLength)) {
+      throw std::runtime_error{ "stems have a sample rate that is not one of tmp::detail::CommonRates" };
+    }
+    tmp::detail::encode_pcm16(mix, std::span{ wav }.subspan(HeaderSize));
+
+    std::ofstream out{ argv[1], std::ios::binary };
+    out.write(reinterpret_cast<char const *>(wav.data()), static_cast<std::streamsize>(wav.size()));
+    if (not out) {
+      throw std::runtime_error{ std::string{ "unable to write " } + argv[1] };
+    }
+  } catch (std::exception const &e) {
+    std::cerr << "stem-mix: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}